@@ -0,0 +1,159 @@
+package com.kdroid.composetray.lib.linux
+
+import com.kdroid.composetray.lib.linux.LinuxTrayManager.MenuItem
+
+/** A menu item as it currently exists natively, under its stable native id. */
+internal class LinuxMenuNode(
+    val id: Int,
+    item: MenuItem,
+    val children: List<LinuxMenuNode>,
+) {
+    // Replaced when a click toggles the item natively, read from the loop thread
+    @Volatile var item: MenuItem = item
+}
+
+/** Native edits issued by [LinuxMenuDiff]; each one touches a single item. */
+internal interface LinuxMenuOps {
+    /** Create [item], without its children, right before [beforeId] (0 = last). Returns its id, or 0. */
+    fun insert(
+        parentId: Int,
+        beforeId: Int,
+        item: MenuItem,
+    ): Int
+
+    fun move(
+        id: Int,
+        parentId: Int,
+        beforeId: Int,
+    )
+
+    /** Remove [id] with its subtree. */
+    fun remove(id: Int)
+
+    /** Apply whatever differs between [old] and [new] to the existing item [id]. */
+    fun update(
+        id: Int,
+        old: MenuItem,
+        new: MenuItem,
+    )
+}
+
+/**
+ * Structural diff between the native menu and a newly built one.
+ *
+ * Siblings are matched by kind, label and occurrence of that label, so duplicate labels stay
+ * distinct; leftovers of the same kind are then paired in order, which turns a relabelled item
+ * into a title update. Matched items keep their native id. Only those outside the longest run
+ * still in order are moved, so a single change in a long menu costs a single native call.
+ */
+internal object LinuxMenuDiff {
+    private data class Key(
+        val kind: String,
+        val label: String,
+        val occurrence: Int,
+    )
+
+    private fun kindOf(item: MenuItem): String =
+        when {
+            item.text == "-" -> "-"
+            item.radioGroup != null -> "radio:" + item.radioGroup
+            item.isCheckable -> "check"
+            else -> "item"
+        }
+
+    private fun keysOf(items: List<MenuItem>): List<Key> {
+        val seen = HashMap<Pair<String, String>, Int>()
+        return items.map { item ->
+            val kind = kindOf(item)
+            val occurrence = seen.merge(kind to item.text, 1, Int::plus)!! - 1
+            Key(kind, item.text, occurrence)
+        }
+    }
+
+    /** Brings the children of [parentId] from [old] to [new] and returns the resulting nodes. */
+    fun reconcile(
+        parentId: Int,
+        old: List<LinuxMenuNode>,
+        new: List<MenuItem>,
+        ops: LinuxMenuOps,
+    ): List<LinuxMenuNode> {
+        // Index into old for each new item, or -1 when it has to be created
+        val matchOf = IntArray(new.size) { -1 }
+        val oldUsed = BooleanArray(old.size)
+
+        val byKey = HashMap<Key, Int>(old.size * 2)
+        keysOf(old.map { it.item }).forEachIndexed { i, key -> byKey[key] = i }
+        keysOf(new).forEachIndexed { i, key ->
+            byKey.remove(key)?.let { o ->
+                matchOf[i] = o
+                oldUsed[o] = true
+            }
+        }
+
+        val leftovers = HashMap<String, ArrayDeque<Int>>()
+        old.indices.filterNot { oldUsed[it] }.forEach { o ->
+            leftovers.getOrPut(kindOf(old[o].item)) { ArrayDeque() }.addLast(o)
+        }
+        for (i in new.indices) {
+            if (matchOf[i] >= 0) continue
+            val o = leftovers[kindOf(new[i])]?.removeFirstOrNull() ?: continue
+            matchOf[i] = o
+            oldUsed[o] = true
+        }
+
+        for (o in old.indices) if (!oldUsed[o]) ops.remove(old[o].id)
+
+        val stable = inOrder(matchOf)
+
+        // Placed from the end, so the successor of every item is already in its final spot
+        val result = arrayOfNulls<LinuxMenuNode>(new.size)
+        var nextId = 0
+        for (i in new.indices.reversed()) {
+            val item = new[i]
+            val o = matchOf[i]
+            val node =
+                if (o >= 0) {
+                    val prev = old[o]
+                    if (!stable[i]) ops.move(prev.id, parentId, nextId)
+                    ops.update(prev.id, prev.item, item)
+                    LinuxMenuNode(prev.id, item, reconcile(prev.id, prev.children, item.subMenuItems, ops))
+                } else {
+                    val id = ops.insert(parentId, nextId, item)
+                    if (id == 0) null else LinuxMenuNode(id, item, reconcile(id, emptyList(), item.subMenuItems, ops))
+                }
+            if (node != null) {
+                result[i] = node
+                nextId = node.id
+            }
+        }
+        return result.filterNotNull()
+    }
+
+    /** Marks the matched items forming the longest increasing run of old positions. */
+    private fun inOrder(matchOf: IntArray): BooleanArray {
+        val stable = BooleanArray(matchOf.size)
+        // tails[k]: index of the smallest tail of an increasing run of length k + 1
+        val tails = IntArray(matchOf.size)
+        val previous = IntArray(matchOf.size) { -1 }
+        var length = 0
+        for (i in matchOf.indices) {
+            val o = matchOf[i]
+            if (o < 0) continue
+            var lo = 0
+            var hi = length
+            while (lo < hi) {
+                val mid = (lo + hi) ushr 1
+                if (matchOf[tails[mid]] < o) lo = mid + 1 else hi = mid
+            }
+            if (lo > 0) previous[i] = tails[lo - 1]
+            tails[lo] = i
+            if (lo == length) length++
+        }
+        var i = if (length > 0) tails[length - 1] else -1
+        while (i >= 0) {
+            stable[i] = true
+            i = previous[i]
+        }
+        return stable
+    }
+}
@@ -36,6 +36,16 @@ internal object LinuxNativeBridge {
         iconBytes: ByteArray,
     )
 
+    /**
+     * Tray icon as ready-made pixmaps: square straight-alpha RGBA images of [sizes] pixels,
+     * back to back in [rgba], smallest first. Skips the native decode and resampling.
+     */
+    @JvmStatic external fun nativeSetIconPixmaps(
+        handle: Long,
+        rgba: ByteArray,
+        sizes: IntArray,
+    )
+
     @JvmStatic external fun nativeSetTitle(
         handle: Long,
         title: String?,
@@ -46,31 +56,133 @@ internal object LinuxNativeBridge {
         tooltip: String?,
     )
 
-    // -- Callbacks ---------------------------------------------------------------
+    /**
+     * Minimum delay between two D-Bus change notifications. Setter bursts within
+     * the interval collapse into one emission of the latest state. Default 16 ms.
+     */
+    @JvmStatic external fun nativeSetFlushInterval(
+        handle: Long,
+        intervalMs: Int,
+    )
 
-    @JvmStatic external fun nativeSetClickCallback(
+    /** Holds back D-Bus notifications until the matching [nativeEndUpdate]; calls nest. */
+    @JvmStatic external fun nativeBeginUpdate(handle: Long)
+
+    @JvmStatic external fun nativeEndUpdate(handle: Long)
+
+    const val STATUS_PASSIVE = 0
+    const val STATUS_ACTIVE = 1
+    const val STATUS_NEEDS_ATTENTION = 2
+
+    /** SNI Status, one of the STATUS_* values. A change is a single NewStatus signal. */
+    @JvmStatic external fun nativeSetStatus(
         handle: Long,
-        callback: Runnable?,
+        status: Int,
     )
 
-    @JvmStatic external fun nativeSetRClickCallback(
+    /** Icon shown on [STATUS_NEEDS_ATTENTION]; decoded immediately. Null clears it. */
+    @JvmStatic external fun nativeSetAttentionIcon(
         handle: Long,
-        callback: Runnable?,
+        iconBytes: ByteArray?,
     )
 
-    /** Register a per-menu-item callback. The callback is keyed by menuId. */
-    @JvmStatic external fun nativeSetMenuItemCallback(
+    /** Template mode: only the tray icon's alpha is kept, painted to match [nativeSetDarkMode]. */
+    @JvmStatic external fun nativeSetIconTemplate(
         handle: Long,
-        menuId: Int,
-        callback: Runnable?,
+        enabled: Boolean,
     )
 
-    /** Register a callback invoked when the menu is about to be shown. */
-    @JvmStatic external fun nativeSetMenuOpenedCallback(
+    /** Panel appearance. Re-tints template icons natively, without re-rendering them. */
+    @JvmStatic external fun nativeSetDarkMode(
         handle: Long,
-        callback: Runnable?,
+        dark: Boolean,
     )
 
+    // -- Events ------------------------------------------------------------------
+
+    const val EVENT_CLICK = 1
+    const val EVENT_RCLICK = 2
+    const val EVENT_MENU_ITEM = 3
+    const val EVENT_MENU_OPENED = 4
+
+    /** The settings portal's color-scheme changed; x carries a COLOR_SCHEME_* value. */
+    const val EVENT_COLOR_SCHEME = 5
+
+    /** Scrolling on the icon; x carries the summed delta, y a SCROLL_* orientation. */
+    const val EVENT_SCROLL = 6
+
+    /** Second activation within the double-click interval; replaces the second [EVENT_CLICK]. */
+    const val EVENT_DOUBLE_CLICK = 7
+
+    /** SecondaryActivate, sent by hosts for a middle click. */
+    const val EVENT_MIDDLE_CLICK = 8
+
+    /** A notification of ours was acted on or closed; itemId is its token, see [nativeNotify]. */
+    const val EVENT_NOTIFICATION = 9
+
+    /** A StatusNotifierHost appeared (x = 1) or the last one went away (x = 0). */
+    const val EVENT_HOST = 10
+
+    const val SCROLL_VERTICAL = 0
+    const val SCROLL_HORIZONTAL = 1
+
+    /** Notification event: x is an action index, y this value. */
+    const val NOTIFY_ACTION = -1
+
+    /** Action index reported when the notification bubble itself was clicked. */
+    const val NOTIFY_DEFAULT_ACTION = -2
+
+    /** Close reason for a notification that was never shown. Other reasons follow the spec (1..4). */
+    const val NOTIFY_FAILED = 0
+
+    const val COLOR_SCHEME_DEFAULT = 0
+    const val COLOR_SCHEME_DARK = 1
+    const val COLOR_SCHEME_LIGHT = 2
+
+    /**
+     * Register the single event dispatcher for a tray (null to clear).
+     * Every click, menu activation and menu-open is delivered through it.
+     */
+    @JvmStatic external fun nativeSetEventDispatcher(
+        handle: Long,
+        dispatcher: TrayEventDispatcher?,
+    )
+
+    /**
+     * Hold [EVENT_CLICK] until the double-click interval has passed, so that a
+     * double click is reported as a single [EVENT_DOUBLE_CLICK] only.
+     */
+    @JvmStatic external fun nativeSetDeferSingleClick(
+        handle: Long,
+        enabled: Boolean,
+    )
+
+    /**
+     * 1 if a StatusNotifierHost is registered, 0 if none (nothing is emitted then),
+     * -1 while unknown.
+     */
+    @JvmStatic external fun nativeGetHostPresent(handle: Long): Int
+
+    /** Last color-scheme read from the XDG settings portal, one of the COLOR_SCHEME_* values. */
+    @JvmStatic external fun nativeGetColorScheme(handle: Long): Int
+
+    // -- Notifications -----------------------------------------------------------
+
+    /**
+     * Post a desktop notification on the tray's bus connection; returns a token (> 0) that
+     * identifies it in [EVENT_NOTIFICATION], or 0. Sent asynchronously and rate limited;
+     * an unsent notification with the same summary is replaced and its token never reports.
+     * [actions] are labels (at most 8), reported back by index.
+     */
+    @JvmStatic external fun nativeNotify(
+        handle: Long,
+        summary: String,
+        body: String?,
+        actions: Array<String>?,
+        withIcon: Boolean,
+        timeoutMs: Int,
+    ): Int
+
     // -- Click position ----------------------------------------------------------
 
     /** Writes [x, y] into outXY. */
@@ -79,6 +191,14 @@ internal object LinuxNativeBridge {
         outXY: IntArray,
     )
 
+    // -- Stats -------------------------------------------------------------------
+
+    /** Writes the health counters into outStats, in [LinuxTrayStats.fromNative] order. */
+    @JvmStatic external fun nativeGetStats(
+        handle: Long,
+        outStats: LongArray,
+    )
+
     // -- Menu management ---------------------------------------------------------
 
     @JvmStatic external fun nativeResetMenu(handle: Long)
@@ -118,6 +238,35 @@ internal object LinuxNativeBridge {
         parentId: Int,
     )
 
+    /**
+     * Insert an item under [parentId] (0 = root) right before [beforeId], or last when it is 0.
+     * Returns the new id, or 0. Ids of existing items never change, so a host with the menu
+     * open is not disturbed.
+     */
+    @JvmStatic external fun nativeInsertMenuItem(
+        handle: Long,
+        parentId: Int,
+        beforeId: Int,
+        title: String?,
+        checkable: Boolean,
+        checked: Boolean,
+        separator: Boolean,
+    ): Int
+
+    /** Re-parent and/or reorder an item with its subtree, as [nativeInsertMenuItem] places new ones. */
+    @JvmStatic external fun nativeMoveMenuItem(
+        handle: Long,
+        id: Int,
+        parentId: Int,
+        beforeId: Int,
+    ): Boolean
+
+    /** Remove an item and its whole subtree. */
+    @JvmStatic external fun nativeRemoveMenuItem(
+        handle: Long,
+        id: Int,
+    ): Boolean
+
     // -- Per-item operations -----------------------------------------------------
 
     @JvmStatic external fun nativeItemSetTitle(
@@ -156,16 +305,39 @@ internal object LinuxNativeBridge {
         id: Int,
     )
 
+    /** Make a checkable item a member of radio [group] (> 0); a checked member becomes the selection. */
+    @JvmStatic external fun nativeItemSetRadioGroup(
+        handle: Long,
+        id: Int,
+        group: Int,
+    )
+
+    /** Select [id] within [group]; one ItemsPropertiesUpdated for the old and new selection. */
+    @JvmStatic external fun nativeGroupSelect(
+        handle: Long,
+        group: Int,
+        id: Int,
+    )
+
+    /** Null clears the icon. */
     @JvmStatic external fun nativeItemSetIcon(
+        handle: Long,
+        id: Int,
+        iconBytes: ByteArray?,
+    )
+
+    /** Like [nativeItemSetIcon], but the icon is a template that follows [nativeSetDarkMode]. */
+    @JvmStatic external fun nativeItemSetIconTemplate(
         handle: Long,
         id: Int,
         iconBytes: ByteArray,
     )
 
+    /** A null [key] clears the shortcut hint. */
     @JvmStatic external fun nativeItemSetShortcut(
         handle: Long,
         id: Int,
-        key: String,
+        key: String?,
         ctrl: Boolean,
         shift: Boolean,
         alt: Boolean,
@@ -174,19 +346,45 @@ internal object LinuxNativeBridge {
 
     // -- X11 outside-click watcher -----------------------------------------------
 
-    /** Open X11 display. Returns handle, or 0 if X11 is unavailable. */
-    @JvmStatic external fun nativeX11OpenDisplay(): Long
+    /**
+     * Start an outside-click watcher on its own X connection and thread. It listens to
+     * XInput2 raw button presses, or samples the pointer at ~60 Hz when libXi is missing.
+     * [callback] is invoked for left-button presses outside the registered rectangles.
+     * Returns a handle, or 0 if X11 is unavailable.
+     */
+    @JvmStatic external fun nativeXiWatcherStart(callback: OutsideClickCallback): Long
 
-    /** Get default root window for the display. */
-    @JvmStatic external fun nativeX11DefaultRootWindow(displayHandle: Long): Long
+    /** Replace the ignored rectangles, flattened as [x, y, width, height] * n in screen coordinates. */
+    @JvmStatic external fun nativeXiWatcherSetRects(
+        handle: Long,
+        rects: IntArray,
+    )
 
-    /** Query pointer. Writes [rootX, rootY, mask] into outData. Returns 1 on success. */
-    @JvmStatic external fun nativeX11QueryPointer(
-        displayHandle: Long,
-        rootWindow: Long,
-        outData: IntArray,
-    ): Int
+    /** Stop the watcher thread and release its X connection. */
+    @JvmStatic external fun nativeXiWatcherStop(handle: Long)
+
+    // -- Callback interface ------------------------------------------------------
+
+    /**
+     * Receives all events of one tray. [itemId] is the native menu item id for
+     * [EVENT_MENU_ITEM] and 0 otherwise; [x]/[y] carry the click position when
+     * the host provides one. [timestampMs] is CLOCK_MONOTONIC milliseconds.
+     */
+    interface TrayEventDispatcher {
+        fun onTrayEvent(
+            eventType: Int,
+            itemId: Int,
+            x: Int,
+            y: Int,
+            timestampMs: Long,
+        )
+    }
 
-    /** Close X11 display. */
-    @JvmStatic external fun nativeX11CloseDisplay(displayHandle: Long)
+    /** Receives presses outside the rectangles registered with [nativeXiWatcherSetRects]. */
+    interface OutsideClickCallback {
+        fun onOutsideClick(
+            x: Int,
+            y: Int,
+        )
+    }
 }
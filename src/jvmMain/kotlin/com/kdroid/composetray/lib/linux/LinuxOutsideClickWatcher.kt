@@ -1,12 +1,12 @@
 package com.kdroid.composetray.lib.linux
 
-import com.kdroid.composetray.utils.isPointWithinLinuxStatusItem
+import com.kdroid.composetray.utils.TrayClickTracker
+import com.kdroid.composetray.utils.linuxStatusItemBounds
 import io.github.kdroidfilter.platformtools.OperatingSystem
 import io.github.kdroidfilter.platformtools.getOperatingSystem
 import java.awt.Window
-import java.util.concurrent.Executors
-import java.util.concurrent.ScheduledExecutorService
-import java.util.concurrent.TimeUnit
+import java.awt.event.ComponentAdapter
+import java.awt.event.ComponentEvent
 
 /**
  * LinuxOutsideClickWatcher: X11/XWayland implementation that detects a left-click anywhere,
@@ -16,109 +16,91 @@ import java.util.concurrent.TimeUnit
  *
  * Notes:
  * - Requires X11/XWayland (DISPLAY must be set). Will no-op on Wayland-only sessions without XWayland.
- * - Polls with XQueryPointer at ~60 Hz, reading Button1Mask for "left pressed".
+ * - A native thread subscribes to XInput2 raw button presses, or samples the pointer at ~60 Hz
+ *   when libXi is missing, and hit-tests every press in C.
+ * - The window and tray icon rectangles are pushed from here only when they change: on window
+ *   move/resize and on a new tray click position, never per event.
  */
 class LinuxOutsideClickWatcher(
     private val windowSupplier: () -> Window?,
     private val onOutsideClick: () -> Unit,
 ) : AutoCloseable {
-    private var scheduler: ScheduledExecutorService? = null
-    private var prevLeft = false
+    @Volatile private var handle: Long = 0L
+    private var trackedWindow: Window? = null
+
+    private val callback =
+        object : LinuxNativeBridge.OutsideClickCallback {
+            override fun onOutsideClick(
+                x: Int,
+                y: Int,
+            ) {
+                val win = windowSupplier.invoke()
+                if (win != null && win.isShowing) onOutsideClick.invoke()
+            }
+        }
 
-    // X11 state (native handles)
-    private var displayHandle: Long = 0L
-    private var rootWindow: Long = 0L
+    private val boundsListener =
+        object : ComponentAdapter() {
+            override fun componentMoved(e: ComponentEvent?) = pushRects()
 
-    fun start() {
-        if (getOperatingSystem() != OperatingSystem.LINUX) return
-        if (scheduler != null) return
+            override fun componentResized(e: ComponentEvent?) = pushRects()
 
-        try {
-            displayHandle = LinuxNativeBridge.nativeX11OpenDisplay()
-            if (displayHandle == 0L) return
-            rootWindow = LinuxNativeBridge.nativeX11DefaultRootWindow(displayHandle)
-        } catch (_: Throwable) {
-            displayHandle = 0L
-            return
+            override fun componentShown(e: ComponentEvent?) = pushRects()
         }
 
-        scheduler =
-            Executors.newSingleThreadScheduledExecutor { r ->
-                Thread(r, "LinuxOutsideClickWatcher").apply { isDaemon = true }
-            }.also { exec ->
-                exec.scheduleAtFixedRate({ pollOnce() }, 0, 16, TimeUnit.MILLISECONDS)
+    private val clickPositionListener: () -> Unit = { pushRects() }
+
+    fun start() {
+        if (getOperatingSystem() != OperatingSystem.LINUX) return
+        if (handle != 0L) return
+        handle =
+            try {
+                LinuxNativeBridge.nativeXiWatcherStart(callback)
+            } catch (_: Throwable) {
+                0L
             }
+        if (handle == 0L) return
+        trackedWindow = windowSupplier.invoke()?.also { it.addComponentListener(boundsListener) }
+        TrayClickTracker.addListener(clickPositionListener)
+        pushRects()
     }
 
-    private fun pollOnce() {
-        if (displayHandle == 0L) return
-        try {
-            val outData = IntArray(3) // [rootX, rootY, mask]
-            val ok = LinuxNativeBridge.nativeX11QueryPointer(displayHandle, rootWindow, outData) != 0
-            if (!ok) return
-
-            val px = outData[0]
-            val py = outData[1]
-            val mask = outData[2]
-            val left = (mask and BUTTON1_MASK) != 0
-
-            // Rising edge: only act once when the button goes down
-            if (left && left != prevLeft) {
-                val win = windowSupplier.invoke()
-                if (win != null && win.isShowing) {
-                    val winLoc =
-                        try {
-                            win.locationOnScreen
-                        } catch (_: Throwable) {
-                            null
-                        }
-                    if (winLoc != null) {
-                        val wx = winLoc.x
-                        val wy = winLoc.y
-                        val ww = win.width
-                        val wh = win.height
-
-                        val insideWindow = px >= wx && px < wx + ww && py >= wy && py < wy + wh
-                        val onTrayIcon =
-                            try {
-                                isPointWithinLinuxStatusItem(px, py)
-                            } catch (_: Throwable) {
-                                false
-                            }
-
-                        if (!insideWindow && !onTrayIcon) {
-                            onOutsideClick.invoke()
-                        }
-                    }
-                }
+    private fun pushRects() {
+        val h = handle
+        if (h == 0L) return
+        val rects = ArrayList<Int>(8)
+        val win = windowSupplier.invoke()
+        val loc =
+            try {
+                win?.takeIf { it.isShowing }?.locationOnScreen
+            } catch (_: Throwable) {
+                null
             }
-
-            prevLeft = left
+        if (win != null && loc != null) rects += listOf(loc.x, loc.y, win.width, win.height)
+        val icon =
+            try {
+                linuxStatusItemBounds()
+            } catch (_: Throwable) {
+                null
+            }
+        if (icon != null) rects += listOf(icon.x, icon.y, icon.width, icon.height)
+        try {
+            LinuxNativeBridge.nativeXiWatcherSetRects(h, rects.toIntArray())
         } catch (_: Throwable) {
-            // Swallow errors to keep the scheduler alive
         }
     }
 
     fun stop() = close()
 
     override fun close() {
+        TrayClickTracker.removeListener(clickPositionListener)
+        trackedWindow?.removeComponentListener(boundsListener)
+        trackedWindow = null
         try {
-            scheduler?.shutdownNow()
-        } catch (_: Throwable) {
-        }
-        scheduler = null
-
-        try {
-            if (displayHandle != 0L) LinuxNativeBridge.nativeX11CloseDisplay(displayHandle)
+            if (handle != 0L) LinuxNativeBridge.nativeXiWatcherStop(handle)
         } catch (_: Throwable) {
         } finally {
-            displayHandle = 0L
-            rootWindow = 0L
+            handle = 0L
         }
     }
-
-    private companion object {
-        // X11 button mask bit for Button1 (left)
-        private const val BUTTON1_MASK = 1 shl 8
-    }
 }
@@ -0,0 +1,45 @@
+package com.kdroid.composetray.lib.linux
+
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.Executors
+import java.util.function.Consumer
+
+/**
+ * Color scheme reported by the XDG settings portal (`org.freedesktop.appearance color-scheme`).
+ *
+ * The native tray subscribes to `SettingChanged` on its own D-Bus connection and reports
+ * through the tray's event dispatcher, so listeners fire once per actual theme change and
+ * nothing polls. Until a tray is running, or without a portal, the scheme stays
+ * [LinuxNativeBridge.COLOR_SCHEME_DEFAULT].
+ */
+internal object LinuxThemeDetector {
+    private val listeners: MutableSet<Consumer<Int>> = ConcurrentHashMap.newKeySet()
+
+    private val callbackExecutor =
+        Executors.newSingleThreadExecutor { r ->
+            Thread(r, "Linux Theme Detector Thread").apply { isDaemon = true }
+        }
+
+    @Volatile
+    var colorScheme: Int = LinuxNativeBridge.COLOR_SCHEME_DEFAULT
+        private set
+
+    /** Called from the tray event loop; hops off it before notifying. */
+    fun onColorSchemeChanged(scheme: Int) {
+        callbackExecutor.execute {
+            if (scheme == colorScheme) return@execute
+            colorScheme = scheme
+            listeners.forEach { it.accept(scheme) }
+        }
+    }
+
+    fun registerListener(listener: Consumer<Int>) {
+        listeners.add(listener)
+        // Notify with current state upon registration
+        listener.accept(colorScheme)
+    }
+
+    fun removeListener(listener: Consumer<Int>) {
+        listeners.remove(listener)
+    }
+}
@@ -1,12 +1,15 @@
 package com.kdroid.composetray.lib.linux
 
+import com.kdroid.composetray.tray.api.TrayScrollOrientation
+import com.kdroid.composetray.tray.api.TrayStatus
+import com.kdroid.composetray.utils.IconRenderCache
+import com.kdroid.composetray.utils.RenderedIcon
 import com.kdroid.composetray.utils.TrayClickTracker
 import com.kdroid.composetray.utils.errorln
-import com.kdroid.composetray.utils.infoln
 import com.kdroid.composetray.utils.warnln
 import io.github.kdroidfilter.platformtools.LinuxDesktopEnvironment
 import io.github.kdroidfilter.platformtools.detectLinuxDesktopEnvironment
-import java.io.File
+import java.util.concurrent.CompletableFuture
 import java.util.concurrent.CountDownLatch
 import java.util.concurrent.atomic.AtomicBoolean
 import java.util.concurrent.locks.ReentrantLock
@@ -28,6 +31,9 @@ internal class LinuxTrayManager(
     companion object {
         // Ensures only one systray runtime is active at a time
         private val lifecyclePermit = java.util.concurrent.Semaphore(1, true)
+
+        // IconPixmap sizes offered to the host, smallest first (ICON_SIZES in sni.c)
+        private val PIXMAP_SIZES = intArrayOf(16, 22, 24, 32, 48, 64, 128)
     }
 
     data class MenuItem(
@@ -36,8 +42,18 @@ internal class LinuxTrayManager(
         val isCheckable: Boolean = false,
         val isChecked: Boolean = false,
         val iconPath: String? = null,
+        // Only the icon's alpha is used; the native side tints it for the panel appearance
+        val iconTemplate: Boolean = false,
+        // Rendered in memory by the menu builder; takes precedence over iconPath
+        val icon: RenderedIcon? = null,
+        // Still rendering: the item is published without it and gets it once done
+        val pendingIcon: CompletableFuture<RenderedIcon>? = null,
+        // Items sharing a group are mutually exclusive (DBusMenu toggle-type "radio")
+        val radioGroup: String? = null,
         val shortcut: com.kdroid.composetray.menu.api.KeyShortcut? = null,
         val onClick: (() -> Unit)? = null,
+        // Checkable items are toggled natively on click, then told their new state
+        val onCheckedChange: ((Boolean) -> Unit)? = null,
         val subMenuItems: List<MenuItem> = emptyList(),
     )
 
@@ -50,9 +66,59 @@ internal class LinuxTrayManager(
     // Menu state built by builder
     private val menuItems: MutableList<MenuItem> = mutableListOf()
 
-    // Mapping from menu item title to native IDs
-    private val idByTitle: MutableMap<String, Int> = mutableMapOf()
-    private val actionById: MutableMap<Int, () -> Unit> = mutableMapOf()
+    // The menu as it exists natively; every update is diffed against it. Guarded by lock.
+    private var appliedMenu: List<LinuxMenuNode> = emptyList()
+
+    // Native radio group ids, stable for the lifetime of the tray
+    private val radioGroupIds: MutableMap<String, Int> = mutableMapOf()
+
+    // Radio groups with a selected member in the menu being synced. Guarded by lock.
+    private var selectedGroups: Set<String> = emptySet()
+
+    // Applied items indexed by native item id, so the dispatcher resolves a menu click
+    // with a single array read. Replaced as a whole after every sync; the loop thread
+    // only ever sees a fully built table.
+    @Volatile
+    private var nodeTable: Array<LinuxMenuNode?> = emptyArray()
+
+    // Single JNI upcall target for every event of this tray
+    private val eventDispatcher =
+        object : LinuxNativeBridge.TrayEventDispatcher {
+            override fun onTrayEvent(
+                eventType: Int,
+                itemId: Int,
+                x: Int,
+                y: Int,
+                timestampMs: Long,
+            ) {
+                when (eventType) {
+                    LinuxNativeBridge.EVENT_CLICK -> {
+                        TrayClickTracker.updateClickPosition(x, y)
+                        onLeftClick?.invoke()
+                    }
+                    LinuxNativeBridge.EVENT_DOUBLE_CLICK -> {
+                        TrayClickTracker.updateClickPosition(x, y)
+                        // Without a double-click listener the second click stays a plain click
+                        (onDoubleClick ?: onLeftClick)?.invoke()
+                    }
+                    LinuxNativeBridge.EVENT_MIDDLE_CLICK -> onMiddleClick?.invoke()
+                    LinuxNativeBridge.EVENT_NOTIFICATION -> dispatchNotification(itemId, x, y)
+                    LinuxNativeBridge.EVENT_HOST -> onHostPresenceChanged?.invoke(x != 0)
+                    LinuxNativeBridge.EVENT_MENU_ITEM -> onMenuItemClicked(itemId)
+                    LinuxNativeBridge.EVENT_MENU_OPENED -> onMenuOpened?.invoke()
+                    LinuxNativeBridge.EVENT_COLOR_SCHEME -> LinuxThemeDetector.onColorSchemeChanged(x)
+                    LinuxNativeBridge.EVENT_SCROLL -> {
+                        val orientation =
+                            if (y == LinuxNativeBridge.SCROLL_HORIZONTAL) {
+                                TrayScrollOrientation.HORIZONTAL
+                            } else {
+                                TrayScrollOrientation.VERTICAL
+                            }
+                        onScroll?.invoke(x, orientation)
+                    }
+                }
+            }
+        }
 
     private fun isKDEDesktop(): Boolean = detectLinuxDesktopEnvironment() == LinuxDesktopEnvironment.KDE
 
@@ -67,33 +133,46 @@ internal class LinuxTrayManager(
         lock.withLock { menuItems.add(menuItem) }
     }
 
-    fun updateMenuItemCheckedState(
-        label: String,
-        isChecked: Boolean,
-    ) {
-        var fallback = false
+    private fun onMenuItemClicked(id: Int) {
+        val node = nodeTable.getOrNull(id) ?: return
+        val item = node.item
+        val onCheckedChange = item.onCheckedChange
+        when {
+            item.radioGroup != null -> {
+                selectRadioItem(node)
+                item.onClick?.invoke()
+            }
+            onCheckedChange != null -> onCheckedChange(toggleChecked(node))
+            else -> item.onClick?.invoke()
+        }
+    }
+
+    private fun toggleChecked(node: LinuxMenuNode): Boolean =
         lock.withLock {
-            val idx = menuItems.indexOfFirst { it.text == label }
-            if (idx != -1) {
-                val current = menuItems[idx]
-                menuItems[idx] = current.copy(isChecked = isChecked)
+            val checked = !node.item.isChecked
+            node.item = node.item.copy(isChecked = checked)
+            val handle = trayHandle
+            if (handle != 0L) {
+                runCatching {
+                    if (checked) native.nativeItemCheck(handle, node.id) else native.nativeItemUncheck(handle, node.id)
+                }
             }
-            val id = idByTitle[label]
-            if (id != null && trayHandle != 0L) {
-                try {
-                    if (isChecked) {
-                        native.nativeItemCheck(trayHandle, id)
-                    } else {
-                        native.nativeItemUncheck(trayHandle, id)
-                    }
-                } catch (_: Throwable) {
-                    fallback = true
+            checked
+        }
+
+    /** Make [node] the selection of its radio group with a single native property update. */
+    private fun selectRadioItem(node: LinuxMenuNode) {
+        lock.withLock {
+            val group = node.item.radioGroup ?: return
+            for (other in nodeTable) {
+                if (other != null && other.item.radioGroup == group) {
+                    other.item = other.item.copy(isChecked = other === node)
                 }
-            } else {
-                fallback = true
             }
+            val groupId = radioGroupIds[group]
+            val handle = trayHandle
+            if (groupId != null && handle != 0L) runCatching { native.nativeGroupSelect(handle, groupId, node.id) }
         }
-        if (fallback) rebuildMenu()
     }
 
     fun update(
@@ -119,13 +198,164 @@ internal class LinuxTrayManager(
             }
         }
 
-        if (iconChanged) setIconFromFileSafe(iconPath)
-        if (tooltipChanged) {
-            runCatching { native.nativeSetTooltip(trayHandle, tooltip) }
-                .onFailure { e -> warnln { "[LinuxTrayManager] Failed to set tooltip: ${e.message}" } }
+        // One transaction: hosts are notified once, with icon, tooltip and menu all current
+        val handle = trayHandle
+        if (handle != 0L) runCatching { native.nativeBeginUpdate(handle) }
+        try {
+            if (iconChanged) setIconFromFileSafe(iconPath)
+            if (tooltipChanged) {
+                runCatching { native.nativeSetTooltip(trayHandle, tooltip) }
+                    .onFailure { e -> warnln { "[LinuxTrayManager] Failed to set tooltip: ${e.message}" } }
+            }
+
+            if (newMenuItems != null) syncMenu()
+        } finally {
+            if (handle != 0L) runCatching { native.nativeEndUpdate(handle) }
+        }
+    }
+
+    // Panel appearance, applied natively: template icons are re-tinted in place
+    @Volatile private var darkMode = true
+
+    @Volatile private var iconTemplate = false
+
+    val isDarkMode: Boolean get() = darkMode
+
+    fun setDarkMode(dark: Boolean) {
+        darkMode = dark
+        val handle = trayHandle
+        if (handle != 0L) runCatching { native.nativeSetDarkMode(handle, dark) }
+    }
+
+    fun setIconTemplate(enabled: Boolean) {
+        iconTemplate = enabled
+        val handle = trayHandle
+        if (handle != 0L) runCatching { native.nativeSetIconTemplate(handle, enabled) }
+    }
+
+    @Volatile private var status = TrayStatus.ACTIVE
+
+    // Already coalesced natively: at most one call per orientation and frame
+    @Volatile var onScroll: ((delta: Int, orientation: TrayScrollOrientation) -> Unit)? = null
+
+    @Volatile private var attentionIconPath: String? = null
+
+    // Classified natively from monotonic timestamps; see [setDeferSingleClick]
+    @Volatile var onDoubleClick: (() -> Unit)? = null
+
+    @Volatile var onMiddleClick: (() -> Unit)? = null
+
+    @Volatile private var deferSingleClick = false
+
+    // No host means the icon is invisible; apps can fall back to a window
+    @Volatile var onHostPresenceChanged: ((present: Boolean) -> Unit)? = null
+
+    /** Whether a StatusNotifierHost shows this tray, or null while unknown. */
+    fun isHostPresent(): Boolean? {
+        val handle = trayHandle
+        if (handle == 0L) return null
+        return when (runCatching { native.nativeGetHostPresent(handle) }.getOrDefault(-1)) {
+            1 -> true
+            0 -> false
+            else -> null
+        }
+    }
+
+    fun setDeferSingleClick(enabled: Boolean) {
+        deferSingleClick = enabled
+        val handle = trayHandle
+        if (handle != 0L) runCatching { native.nativeSetDeferSingleClick(handle, enabled) }
+    }
+
+    fun setStatus(newStatus: TrayStatus) {
+        status = newStatus
+        val handle = trayHandle
+        if (handle != 0L) runCatching { native.nativeSetStatus(handle, newStatus.toNative()) }
+    }
+
+    fun setAttentionIcon(path: String?) {
+        attentionIconPath = path
+        val handle = trayHandle
+        if (handle != 0L) applyAttentionIcon(handle, path)
+    }
+
+    private fun applyAttentionIcon(
+        handle: Long,
+        path: String?,
+    ) {
+        runCatching {
+            val bytes = path?.let(IconRenderCache::readBytes)
+            native.nativeSetAttentionIcon(handle, bytes)
+        }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to set attention icon: ${e.message}" } }
+    }
+
+    private fun TrayStatus.toNative(): Int =
+        when (this) {
+            TrayStatus.PASSIVE -> LinuxNativeBridge.STATUS_PASSIVE
+            TrayStatus.ACTIVE -> LinuxNativeBridge.STATUS_ACTIVE
+            TrayStatus.NEEDS_ATTENTION -> LinuxNativeBridge.STATUS_NEEDS_ATTENTION
+        }
+
+    // Notification listeners by native token, dropped once the notification closes.
+    // Guarded by itself so that an event can never overtake the registration.
+    private val notificationListeners = HashMap<Int, NotificationListener>()
+
+    class NotificationListener(
+        val onAction: ((index: Int) -> Unit)?,
+        val onClosed: ((reason: Int) -> Unit)?,
+    )
+
+    /** Post a notification through the tray's bus connection. Returns its token, or 0. */
+    fun notify(
+        summary: String,
+        body: String?,
+        actions: List<String>,
+        withIcon: Boolean,
+        timeoutMs: Int,
+        listener: NotificationListener?,
+    ): Int {
+        val handle = trayHandle
+        if (handle == 0L) return 0
+        return synchronized(notificationListeners) {
+            val token =
+                runCatching {
+                    native.nativeNotify(handle, summary, body, actions.toTypedArray(), withIcon, timeoutMs)
+                }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to post notification: ${e.message}" } }
+                    .getOrDefault(0)
+            if (token != 0 && listener != null) notificationListeners[token] = listener
+            token
+        }
+    }
+
+    private fun dispatchNotification(
+        token: Int,
+        action: Int,
+        reason: Int,
+    ) {
+        val listener =
+            synchronized(notificationListeners) {
+                if (reason == LinuxNativeBridge.NOTIFY_ACTION) {
+                    notificationListeners[token]
+                } else {
+                    notificationListeners.remove(token)
+                }
+            } ?: return
+        if (reason == LinuxNativeBridge.NOTIFY_ACTION) {
+            listener.onAction?.invoke(if (action == LinuxNativeBridge.NOTIFY_DEFAULT_ACTION) -1 else action)
+        } else {
+            listener.onClosed?.invoke(reason)
         }
+    }
 
-        if (newMenuItems != null) rebuildMenu()
+    /** Native health counters, or null when the tray is not running. */
+    fun stats(): LinuxTrayStats? {
+        val handle = trayHandle
+        if (handle == 0L) return null
+        return runCatching {
+            val values = LongArray(LinuxTrayStats.FIELD_COUNT)
+            native.nativeGetStats(handle, values)
+            LinuxTrayStats.fromNative(values)
+        }.getOrNull()
     }
 
     fun startTray() {
@@ -149,50 +379,39 @@ internal class LinuxTrayManager(
 
             val readyLatch = CountDownLatch(1)
 
-            // Read initial icon bytes
+            // Rendered icons go out as ready-made pixmaps; only file icons need a native decode
+            val renderedIcon = IconRenderCache.iconFor(iconPath)
             val iconBytes =
-                runCatching { File(iconPath).takeIf { it.isFile }?.readBytes() }
-                    .getOrNull()
+                if (renderedIcon != null) {
+                    null
+                } else {
+                    runCatching { IconRenderCache.readBytes(iconPath) }.getOrNull()
+                }
 
-            // Create native tray
+            // Create native tray. Returns immediately: the icon decodes on a native worker.
             trayHandle = native.nativeCreate(iconBytes, tooltip)
             if (trayHandle == 0L) {
                 errorln { "[LinuxTrayManager] Failed to create native tray" }
                 return
             }
 
-            // Set title
-            runCatching { native.nativeSetTitle(trayHandle, tooltip) }
-
-            // Set click callback
-            native.nativeSetClickCallback(
-                trayHandle,
-                JniRunnable {
-                    try {
-                        val xy = IntArray(2)
-                        native.nativeGetLastClickXY(trayHandle, xy)
-                        TrayClickTracker.updateClickPosition(xy[0], xy[1])
-                    } catch (_: Throwable) {
-                    }
-                    onLeftClick?.invoke()
-                },
-            )
-
-            // Set menu-opened callback
-            native.nativeSetMenuOpenedCallback(
-                trayHandle,
-                JniRunnable { onMenuOpened?.invoke() },
-            )
-
-            // Build menu before starting the loop
-            rebuildMenu()
-
-            // Start event loop in daemon thread
+            // Route clicks, menu activations and menu-open events through one dispatcher
+            native.nativeSetEventDispatcher(trayHandle, eventDispatcher)
+            renderedIcon?.let { runCatching { applyIconPixmaps(trayHandle, it) } }
+            native.nativeSetDarkMode(trayHandle, darkMode)
+            native.nativeSetIconTemplate(trayHandle, iconTemplate)
+            native.nativeSetStatus(trayHandle, status.toNative())
+            native.nativeSetDeferSingleClick(trayHandle, deferSingleClick)
+            attentionIconPath?.let { applyAttentionIcon(trayHandle, it) }
+
+            // Start the event loop right away so the bus connection, object export and
+            // watcher registration overlap with the icon decode and the menu build below.
+            val handle = trayHandle
             loopThread =
                 Thread({
                     try {
                         readyLatch.countDown()
-                        native.nativeRun(trayHandle)
+                        native.nativeRun(handle)
                     } catch (t: Throwable) {
                         errorln { "[LinuxTrayManager] loop error: $t" }
                     }
@@ -201,6 +420,12 @@ internal class LinuxTrayManager(
                     start()
                 }
 
+            // Set title
+            runCatching { native.nativeSetTitle(trayHandle, tooltip) }
+
+            // Build menu; changes are flushed by the loop once connected
+            syncMenu()
+
             try {
                 readyLatch.await()
             } catch (_: InterruptedException) {
@@ -267,8 +492,11 @@ internal class LinuxTrayManager(
 
         trayHandle = 0L
         loopThread = null
-        idByTitle.clear()
-        actionById.clear()
+        lock.withLock {
+            appliedMenu = emptyList()
+            radioGroupIds.clear()
+        }
+        nodeTable = emptyArray()
         try {
             shutdownHook?.let { Runtime.getRuntime().removeShutdownHook(it) }
         } catch (_: Throwable) {
@@ -283,103 +511,212 @@ internal class LinuxTrayManager(
     }
 
     // ----------------------------------------------------------------------------------------
+    private fun applyIconPixmaps(
+        handle: Long,
+        icon: RenderedIcon,
+    ) = native.nativeSetIconPixmaps(handle, icon.rgbaLadder(PIXMAP_SIZES), PIXMAP_SIZES)
+
     private fun setIconFromFileSafe(path: String) {
         runCatching {
-            val file = File(path)
-            if (file.isFile && trayHandle != 0L) {
-                native.nativeSetIcon(trayHandle, file.readBytes())
+            val rendered = IconRenderCache.iconFor(path)
+            if (rendered != null) {
+                if (trayHandle != 0L) applyIconPixmaps(trayHandle, rendered)
+                return@runCatching
+            }
+            // User-supplied paths are read from disk and decoded natively
+            val bytes = IconRenderCache.readBytes(path)
+            if (bytes != null && trayHandle != 0L) {
+                native.nativeSetIcon(trayHandle, bytes)
             } else {
                 warnln { "[LinuxTrayManager] Icon file not found: $path" }
             }
         }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to set icon from $path: ${e.message}" } }
     }
 
-    private fun rebuildMenu() {
+    /**
+     * Bring the native menu in line with [menuItems] through [LinuxMenuDiff]: only inserted,
+     * removed, moved or changed items are touched and every other item keeps its native id.
+     * If the native side rejects an edit, the menu is rebuilt from scratch instead.
+     */
+    private fun syncMenu() {
         if (trayHandle == 0L) return
-        infoln { "[LinuxTrayManager] Rebuilding menu" }
-        idByTitle.clear()
-        actionById.clear()
-        runCatching { native.nativeResetMenu(trayHandle) }
-        val items = lock.withLock { menuItems.toList() }
-        // KDE quirk: empty menu causes issues, add dummy separator
-        val effectiveItems = if (items.isEmpty() && isKDEDesktop()) listOf(MenuItem("-")) else items
-        effectiveItems.forEach { addMenuItemRecursive(null, it) }
+        lock.withLock {
+            val items = menuItems.toList()
+            // KDE quirk: empty menu causes issues, add dummy separator
+            val effectiveItems = if (items.isEmpty() && isKDEDesktop()) listOf(MenuItem("-")) else items
+            selectedGroups = selectedRadioGroups(effectiveItems)
+            appliedMenu =
+                try {
+                    LinuxMenuDiff.reconcile(0, appliedMenu, effectiveItems, nativeMenuOps)
+                } catch (t: Throwable) {
+                    warnln { "[LinuxTrayManager] Menu diff failed, rebuilding: $t" }
+                    runCatching { native.nativeResetMenu(trayHandle) }
+                    radioGroupIds.clear()
+                    LinuxMenuDiff.reconcile(0, emptyList(), effectiveItems, nativeMenuOps)
+                }
+            nodeTable = buildNodeTable(appliedMenu)
+        }
     }
 
-    private fun addMenuItemRecursive(
-        parentId: Int?,
-        item: MenuItem,
-    ) {
-        try {
-            if (item.text == "-") {
-                if (parentId == null) {
-                    native.nativeAddSeparator(trayHandle)
-                } else {
-                    runCatching { native.nativeAddSubSeparator(trayHandle, parentId) }
-                        .onFailure {
-                            val id = native.nativeAddSubMenuItem(trayHandle, parentId, "-", null)
-                            native.nativeItemDisable(trayHandle, id)
-                        }
+    private fun selectedRadioGroups(items: List<MenuItem>): Set<String> {
+        val groups = HashSet<String>()
+
+        fun collect(list: List<MenuItem>) {
+            for (item in list) {
+                if (item.isChecked) item.radioGroup?.let(groups::add)
+                collect(item.subMenuItems)
+            }
+        }
+        collect(items)
+        return groups
+    }
+
+    private fun buildNodeTable(nodes: List<LinuxMenuNode>): Array<LinuxMenuNode?> {
+        val all = ArrayList<LinuxMenuNode>()
+
+        fun collect(list: List<LinuxMenuNode>) {
+            for (node in list) {
+                all.add(node)
+                collect(node.children)
+            }
+        }
+        collect(nodes)
+        val table = arrayOfNulls<LinuxMenuNode>((all.maxOfOrNull { it.id } ?: 0) + 1)
+        for (node in all) table[node.id] = node
+        return table
+    }
+
+    // Runs under lock, from syncMenu only
+    private val nativeMenuOps =
+        object : LinuxMenuOps {
+            override fun insert(
+                parentId: Int,
+                beforeId: Int,
+                item: MenuItem,
+            ): Int {
+                val separator = item.text == "-"
+                val id =
+                    native.nativeInsertMenuItem(
+                        trayHandle,
+                        parentId,
+                        beforeId,
+                        if (separator) null else item.text,
+                        item.isCheckable,
+                        item.isChecked,
+                        separator,
+                    )
+                if (id == 0 || separator) return id
+
+                item.radioGroup?.let { group ->
+                    val groupId = radioGroupIds.getOrPut(group) { radioGroupIds.size + 1 }
+                    native.nativeItemSetRadioGroup(trayHandle, id, groupId)
                 }
-                return
+                // New items start enabled; only a disabled state needs a native call
+                if (!item.isEnabled) native.nativeItemDisable(trayHandle, id)
+                if (item.icon != null || item.iconPath != null) applyItemIcon(id, item)
+                if (item.pendingIcon != null) attachWhenRendered(id, item)
+                item.shortcut?.let { applyItemShortcut(id, it) }
+                return id
+            }
+
+            override fun move(
+                id: Int,
+                parentId: Int,
+                beforeId: Int,
+            ) {
+                check(native.nativeMoveMenuItem(trayHandle, id, parentId, beforeId)) { "move of item $id rejected" }
+            }
+
+            override fun remove(id: Int) {
+                check(native.nativeRemoveMenuItem(trayHandle, id)) { "removal of item $id rejected" }
             }
 
-            val id =
-                if (parentId == null) {
-                    if (item.isCheckable) {
-                        native.nativeAddMenuItemCheckbox(trayHandle, item.text, null, item.isChecked)
+            override fun update(
+                id: Int,
+                old: MenuItem,
+                new: MenuItem,
+            ) {
+                if (new.text == "-") return
+                if (old.text != new.text) native.nativeItemSetTitle(trayHandle, id, new.text)
+                if (old.isEnabled != new.isEnabled) {
+                    if (new.isEnabled) {
+                        native.nativeItemEnable(trayHandle, id)
                     } else {
-                        native.nativeAddMenuItem(trayHandle, item.text, null)
+                        native.nativeItemDisable(trayHandle, id)
                     }
-                } else {
-                    if (item.isCheckable) {
-                        native.nativeAddSubMenuItemCheckbox(trayHandle, parentId, item.text, null, item.isChecked)
-                    } else {
-                        native.nativeAddSubMenuItem(trayHandle, parentId, item.text, null)
+                }
+                if (old.isChecked != new.isChecked) {
+                    val groupId = new.radioGroup?.let(radioGroupIds::get)
+                    when {
+                        groupId != null && new.isChecked -> native.nativeGroupSelect(trayHandle, groupId, id)
+                        // Selecting the new member clears this one natively
+                        groupId != null && new.radioGroup in selectedGroups -> Unit
+                        new.isChecked -> native.nativeItemCheck(trayHandle, id)
+                        else -> native.nativeItemUncheck(trayHandle, id)
                     }
                 }
-            idByTitle[item.text] = id
-            item.onClick?.let { action ->
-                actionById[id] = action
-                native.nativeSetMenuItemCallback(trayHandle, id, JniRunnable { action() })
+                val iconChanged =
+                    old.icon?.contentHash != new.icon?.contentHash ||
+                        old.iconPath != new.iconPath ||
+                        old.iconTemplate != new.iconTemplate
+                // A pending icon replaces the current one only once rendered, so it never blinks
+                if (new.pendingIcon != null) {
+                    attachWhenRendered(id, new)
+                } else if (iconChanged) {
+                    applyItemIcon(id, new)
+                }
+                if (old.shortcut != new.shortcut) applyItemShortcut(id, new.shortcut)
             }
+        }
 
-            // Enable/Disable
-            if (item.isEnabled) {
-                native.nativeItemEnable(trayHandle, id)
+    private fun applyItemIcon(
+        id: Int,
+        item: MenuItem,
+    ) {
+        runCatching {
+            val bytes = item.icon?.pngBytes ?: item.iconPath?.let(IconRenderCache::readBytes)
+            if (bytes != null && item.iconTemplate) {
+                native.nativeItemSetIconTemplate(trayHandle, id, bytes)
             } else {
-                native.nativeItemDisable(trayHandle, id)
-            }
-
-            // Icon
-            item.iconPath?.let { iconPath ->
-                runCatching {
-                    val bytes = File(iconPath).takeIf { it.isFile }?.readBytes()
-                    if (bytes != null) native.nativeItemSetIcon(trayHandle, id, bytes)
-                }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to set menu item icon: ${e.message}" } }
-            }
-
-            // Keyboard shortcut hint
-            item.shortcut?.let { shortcut ->
-                runCatching {
-                    native.nativeItemSetShortcut(
-                        trayHandle,
-                        id,
-                        shortcut.toLinuxKey(),
-                        shortcut.ctrl,
-                        shortcut.shift,
-                        shortcut.alt,
-                        shortcut.meta,
-                    )
-                }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to set shortcut: ${e.message}" } }
+                native.nativeItemSetIcon(trayHandle, id, bytes)
             }
+        }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to set menu item icon: ${e.message}" } }
+    }
 
-            // Submenu
-            if (item.subMenuItems.isNotEmpty()) {
-                item.subMenuItems.forEach { sub -> addMenuItemRecursive(id, sub) }
+    // Async, so that it never runs under the lock of the sync that registered it; by then the
+    // item may have been replaced or removed, and a newer icon requested for it
+    private fun attachWhenRendered(
+        id: Int,
+        item: MenuItem,
+    ) {
+        val pending = item.pendingIcon ?: return
+        pending.thenAcceptAsync { icon ->
+            lock.withLock {
+                val node = nodeTable.getOrNull(id) ?: return@withLock
+                if (trayHandle == 0L || node.item.pendingIcon !== pending) return@withLock
+                val rendered = node.item.copy(icon = icon, pendingIcon = null)
+                node.item = rendered
+                // Composable icons are rendered on every build; identical pixels are a native no-op
+                applyItemIcon(id, rendered)
             }
-        } catch (t: Throwable) {
-            errorln { "[LinuxTrayManager] Error adding menu item '${item.text}': $t" }
         }
     }
+
+    // Keyboard shortcut hint; null clears it
+    private fun applyItemShortcut(
+        id: Int,
+        shortcut: com.kdroid.composetray.menu.api.KeyShortcut?,
+    ) {
+        runCatching {
+            native.nativeItemSetShortcut(
+                trayHandle,
+                id,
+                shortcut?.toLinuxKey(),
+                shortcut?.ctrl == true,
+                shortcut?.shift == true,
+                shortcut?.alt == true,
+                shortcut?.meta == true,
+            )
+        }.onFailure { e -> warnln { "[LinuxTrayManager] Failed to set shortcut: ${e.message}" } }
+    }
 }
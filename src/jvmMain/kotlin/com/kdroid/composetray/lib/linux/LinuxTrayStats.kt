@@ -0,0 +1,34 @@
+package com.kdroid.composetray.lib.linux
+
+/**
+ * Health counters of a native Linux tray (mirrors `sni_tray_stats`).
+ *
+ * @property registrations times the StatusNotifierWatcher accepted our item
+ * @property reconnects times the session bus connection was re-established
+ * @property recoveries times the item became visible again after a bus loss or a watcher restart
+ * @property lastRecoveryMs duration of the latest recovery, from loss to re-registration; -1 if none yet
+ * @property startupLatencyMs time from `nativeCreate` to the first accepted registration; -1 until then
+ * @property suppressedUpdates setter calls dropped natively because the value did not change
+ */
+internal data class LinuxTrayStats(
+    val registrations: Long,
+    val reconnects: Long,
+    val recoveries: Long,
+    val lastRecoveryMs: Long,
+    val startupLatencyMs: Long,
+    val suppressedUpdates: Long,
+) {
+    companion object {
+        const val FIELD_COUNT = 6
+
+        fun fromNative(values: LongArray): LinuxTrayStats =
+            LinuxTrayStats(
+                registrations = values[0],
+                reconnects = values[1],
+                recoveries = values[2],
+                lastRecoveryMs = values[3],
+                startupLatencyMs = values[4],
+                suppressedUpdates = values[5],
+            )
+    }
+}
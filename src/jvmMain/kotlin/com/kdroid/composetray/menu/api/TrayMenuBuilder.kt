@@ -216,6 +216,29 @@ interface TrayMenuBuilder {
         CheckableItem(label, checked, onToggle, isEnabled)
     }
 
+    /**
+     * Adds a radio item to the tray menu. Items sharing the same [group] are mutually
+     * exclusive: selecting one deselects the others.
+     *
+     * @param label The text label for the radio item.
+     * @param group Identifier of the radio group the item belongs to.
+     * @param selected Whether this item is the group's current selection.
+     * @param onSelect Called when the user selects the item.
+     * @param isEnabled Determines if the radio item is enabled. Defaults to true.
+     * @param shortcut Optional keyboard shortcut hint displayed next to the item. Display-only, does not register a hotkey.
+     */
+    fun RadioItem(
+        label: String,
+        group: String,
+        selected: Boolean,
+        onSelect: () -> Unit,
+        isEnabled: Boolean = true,
+        shortcut: KeyShortcut? = null,
+    ) {
+        // Platforms without native radio items show a checkmark; the group is driven by [selected]
+        CheckableItem(label, selected, { checked -> if (checked) onSelect() }, isEnabled, shortcut)
+    }
+
     /**
      * Adds a submenu to the tray menu.
      *
@@ -11,11 +11,11 @@ import androidx.compose.ui.graphics.vector.ImageVector
 import com.kdroid.composetray.lib.linux.LinuxTrayManager
 import com.kdroid.composetray.menu.api.KeyShortcut
 import com.kdroid.composetray.menu.api.TrayMenuBuilder
-import com.kdroid.composetray.utils.ComposableIconUtils
 import com.kdroid.composetray.utils.IconRenderProperties
-import com.kdroid.composetray.utils.isMenuBarInDarkMode
+import com.kdroid.composetray.utils.RenderedIcon
 import org.jetbrains.compose.resources.DrawableResource
 import org.jetbrains.compose.resources.painterResource
+import java.util.concurrent.CompletableFuture
 import java.util.concurrent.locks.ReentrantLock
 import kotlin.concurrent.withLock
 
@@ -57,15 +57,28 @@ internal class LinuxTrayMenuBuilderImpl(
         isEnabled: Boolean,
         shortcut: KeyShortcut?,
         onClick: () -> Unit,
+    ) = addItem(label, iconContent, null, null, iconRenderProperties, isEnabled, shortcut, onClick)
+
+    private fun addItem(
+        label: String,
+        iconContent: @Composable () -> Unit,
+        iconSource: Any?,
+        iconTint: Color?,
+        iconRenderProperties: IconRenderProperties,
+        isEnabled: Boolean,
+        shortcut: KeyShortcut?,
+        onClick: () -> Unit,
+        iconTemplate: Boolean = false,
     ) {
+        val icon = menuIcon(iconContent, iconSource, iconTint, iconRenderProperties, iconTemplate)
         lock.withLock {
-            val iconPath = ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
-
             val menuItem =
                 LinuxTrayManager.MenuItem(
                     text = label,
                     isEnabled = isEnabled,
-                    iconPath = iconPath,
+                    icon = icon.renderedOrNull(),
+                    pendingIcon = icon.takeUnless { it.isDone },
+                    iconTemplate = iconTemplate,
                     shortcut = shortcut,
                     onClick = onClick,
                 )
@@ -83,24 +96,17 @@ internal class LinuxTrayMenuBuilderImpl(
         shortcut: KeyShortcut?,
         onClick: () -> Unit,
     ) {
-        val iconContent: @Composable () -> Unit = {
-            val isDark = isMenuBarInDarkMode()
-
-            Image(
-                imageVector = icon,
-                contentDescription = null,
-                modifier = Modifier.fillMaxSize(),
-                colorFilter =
-                    iconTint?.let { ColorFilter.tint(it) }
-                        ?: if (isDark) {
-                            ColorFilter.tint(Color.White)
-                        } else {
-                            ColorFilter.tint(Color.Black)
-                        },
-            )
-        }
-
-        Item(label, iconContent, iconRenderProperties, isEnabled, shortcut, onClick)
+        addItem(
+            label,
+            vectorIconContent(icon, iconTint),
+            icon,
+            iconTint,
+            iconRenderProperties,
+            isEnabled,
+            shortcut,
+            onClick,
+            iconTemplate = iconTint == null,
+        )
     }
 
     override fun Item(
@@ -119,7 +125,7 @@ internal class LinuxTrayMenuBuilderImpl(
             )
         }
 
-        Item(label, iconContent, iconRenderProperties, isEnabled, shortcut, onClick)
+        addItem(label, iconContent, icon, null, iconRenderProperties, isEnabled, shortcut, onClick)
     }
 
     override fun Item(
@@ -137,7 +143,7 @@ internal class LinuxTrayMenuBuilderImpl(
                 modifier = Modifier.fillMaxSize(),
             )
         }
-        Item(label, iconContent, iconRenderProperties, isEnabled, shortcut, onClick)
+        addItem(label, iconContent, icon, null, iconRenderProperties, isEnabled, shortcut, onClick)
     }
 
     override fun CheckableItem(
@@ -148,25 +154,14 @@ internal class LinuxTrayMenuBuilderImpl(
         shortcut: KeyShortcut?,
     ) {
         lock.withLock {
-            val initialChecked = checked
-
             val menuItem =
                 LinuxTrayManager.MenuItem(
                     text = label,
                     isEnabled = isEnabled,
                     isCheckable = true,
-                    isChecked = initialChecked,
+                    isChecked = checked,
                     shortcut = shortcut,
-                    onClick = {
-                        lock.withLock {
-                            val currentMenuItem = menuItems.find { it.text == label }
-                            val currentChecked = currentMenuItem?.isChecked ?: initialChecked
-                            val newChecked = !currentChecked
-
-                            onCheckedChange(newChecked)
-                            trayManager?.updateMenuItemCheckedState(label, newChecked)
-                        }
-                    },
+                    onCheckedChange = onCheckedChange,
                 )
             menuItems.add(menuItem)
             persistentMenuItems.add(menuItem)
@@ -181,30 +176,43 @@ internal class LinuxTrayMenuBuilderImpl(
         onCheckedChange: (Boolean) -> Unit,
         isEnabled: Boolean,
         shortcut: KeyShortcut?,
+    ) = addCheckableItem(
+        label,
+        iconContent,
+        null,
+        null,
+        iconRenderProperties,
+        checked,
+        onCheckedChange,
+        isEnabled,
+        shortcut,
+    )
+
+    private fun addCheckableItem(
+        label: String,
+        iconContent: @Composable () -> Unit,
+        iconSource: Any?,
+        iconTint: Color?,
+        iconRenderProperties: IconRenderProperties,
+        checked: Boolean,
+        onCheckedChange: (Boolean) -> Unit,
+        isEnabled: Boolean,
+        shortcut: KeyShortcut?,
+        iconTemplate: Boolean = false,
     ) {
+        val icon = menuIcon(iconContent, iconSource, iconTint, iconRenderProperties, iconTemplate)
         lock.withLock {
-            val iconPath = ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
-
-            val initialChecked = checked
-
             val menuItem =
                 LinuxTrayManager.MenuItem(
                     text = label,
                     isEnabled = isEnabled,
                     isCheckable = true,
-                    isChecked = initialChecked,
-                    iconPath = iconPath,
+                    isChecked = checked,
+                    icon = icon.renderedOrNull(),
+                    pendingIcon = icon.takeUnless { it.isDone },
+                    iconTemplate = iconTemplate,
                     shortcut = shortcut,
-                    onClick = {
-                        lock.withLock {
-                            val currentMenuItem = menuItems.find { it.text == label }
-                            val currentChecked = currentMenuItem?.isChecked ?: initialChecked
-                            val newChecked = !currentChecked
-
-                            onCheckedChange(newChecked)
-                            trayManager?.updateMenuItemCheckedState(label, newChecked)
-                        }
-                    },
+                    onCheckedChange = onCheckedChange,
                 )
             menuItems.add(menuItem)
             persistentMenuItems.add(menuItem)
@@ -221,24 +229,18 @@ internal class LinuxTrayMenuBuilderImpl(
         isEnabled: Boolean,
         shortcut: KeyShortcut?,
     ) {
-        val iconContent: @Composable () -> Unit = {
-            val isDark = isMenuBarInDarkMode()
-
-            Image(
-                imageVector = icon,
-                contentDescription = null,
-                modifier = Modifier.fillMaxSize(),
-                colorFilter =
-                    iconTint?.let { ColorFilter.tint(it) }
-                        ?: if (isDark) {
-                            ColorFilter.tint(Color.White)
-                        } else {
-                            ColorFilter.tint(Color.Black)
-                        },
-            )
-        }
-
-        CheckableItem(label, iconContent, iconRenderProperties, checked, onCheckedChange, isEnabled, shortcut)
+        addCheckableItem(
+            label,
+            vectorIconContent(icon, iconTint),
+            icon,
+            iconTint,
+            iconRenderProperties,
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+            iconTemplate = iconTint == null,
+        )
     }
 
     override fun CheckableItem(
@@ -258,7 +260,17 @@ internal class LinuxTrayMenuBuilderImpl(
             )
         }
 
-        CheckableItem(label, iconContent, iconRenderProperties, checked, onCheckedChange, isEnabled, shortcut)
+        addCheckableItem(
+            label,
+            iconContent,
+            icon,
+            null,
+            iconRenderProperties,
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+        )
     }
 
     override fun CheckableItem(
@@ -277,7 +289,42 @@ internal class LinuxTrayMenuBuilderImpl(
                 modifier = Modifier.fillMaxSize(),
             )
         }
-        CheckableItem(label, iconContent, iconRenderProperties, checked, onCheckedChange, isEnabled, shortcut)
+        addCheckableItem(
+            label,
+            iconContent,
+            icon,
+            null,
+            iconRenderProperties,
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+        )
+    }
+
+    override fun RadioItem(
+        label: String,
+        group: String,
+        selected: Boolean,
+        onSelect: () -> Unit,
+        isEnabled: Boolean,
+        shortcut: KeyShortcut?,
+    ) {
+        lock.withLock {
+            val menuItem =
+                LinuxTrayManager.MenuItem(
+                    text = label,
+                    isEnabled = isEnabled,
+                    isCheckable = true,
+                    isChecked = selected,
+                    radioGroup = group,
+                    shortcut = shortcut,
+                    // The manager moves the selection natively before calling back
+                    onClick = onSelect,
+                )
+            menuItems.add(menuItem)
+            persistentMenuItems.add(menuItem)
+        }
     }
 
     override fun SubMenu(
@@ -314,6 +361,17 @@ internal class LinuxTrayMenuBuilderImpl(
         iconRenderProperties: IconRenderProperties,
         isEnabled: Boolean,
         submenuContent: (TrayMenuBuilder.() -> Unit)?,
+    ) = addSubMenu(label, iconContent, null, null, iconRenderProperties, isEnabled, submenuContent)
+
+    private fun addSubMenu(
+        label: String,
+        iconContent: @Composable () -> Unit,
+        iconSource: Any?,
+        iconTint: Color?,
+        iconRenderProperties: IconRenderProperties,
+        isEnabled: Boolean,
+        submenuContent: (TrayMenuBuilder.() -> Unit)?,
+        iconTemplate: Boolean = false,
     ) {
         val subMenuItems = mutableListOf<LinuxTrayManager.MenuItem>()
         if (submenuContent != null) {
@@ -327,14 +385,15 @@ internal class LinuxTrayMenuBuilderImpl(
             subMenuItems.addAll(subMenuImpl.menuItems)
         }
 
+        val icon = menuIcon(iconContent, iconSource, iconTint, iconRenderProperties, iconTemplate)
         lock.withLock {
-            val iconPath = ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
-
             val subMenu =
                 LinuxTrayManager.MenuItem(
                     text = label,
                     isEnabled = isEnabled,
-                    iconPath = iconPath,
+                    icon = icon.renderedOrNull(),
+                    pendingIcon = icon.takeUnless { it.isDone },
+                    iconTemplate = iconTemplate,
                     subMenuItems = subMenuItems,
                 )
             menuItems.add(subMenu)
@@ -350,23 +409,16 @@ internal class LinuxTrayMenuBuilderImpl(
         isEnabled: Boolean,
         submenuContent: (TrayMenuBuilder.() -> Unit)?,
     ) {
-        val iconContent: @Composable () -> Unit = {
-            val isDark = isMenuBarInDarkMode()
-            Image(
-                imageVector = icon,
-                contentDescription = null,
-                modifier = Modifier.fillMaxSize(),
-                colorFilter =
-                    iconTint?.let { ColorFilter.tint(it) }
-                        ?: if (isDark) {
-                            ColorFilter.tint(Color.White)
-                        } else {
-                            ColorFilter.tint(Color.Black)
-                        },
-            )
-        }
-
-        SubMenu(label, iconContent, iconRenderProperties, isEnabled, submenuContent)
+        addSubMenu(
+            label,
+            vectorIconContent(icon, iconTint),
+            icon,
+            iconTint,
+            iconRenderProperties,
+            isEnabled,
+            submenuContent,
+            iconTemplate = iconTint == null,
+        )
     }
 
     override fun SubMenu(
@@ -384,7 +436,7 @@ internal class LinuxTrayMenuBuilderImpl(
             )
         }
 
-        SubMenu(label, iconContent, iconRenderProperties, isEnabled, submenuContent)
+        addSubMenu(label, iconContent, icon, null, iconRenderProperties, isEnabled, submenuContent)
     }
 
     override fun SubMenu(
@@ -401,9 +453,44 @@ internal class LinuxTrayMenuBuilderImpl(
                 modifier = Modifier.fillMaxSize(),
             )
         }
-        SubMenu(label, iconContent, iconRenderProperties, isEnabled, submenuContent)
+        addSubMenu(label, iconContent, icon, null, iconRenderProperties, isEnabled, submenuContent)
+    }
+
+    // Cached icons are attached right away; the others are rendered in the background and
+    // attached by the tray manager once done, after the menu itself has been published.
+    // A null iconSource is composable content, rendered again on every build.
+    private fun menuIcon(
+        iconContent: @Composable () -> Unit,
+        iconSource: Any?,
+        iconTint: Color?,
+        iconRenderProperties: IconRenderProperties,
+        iconTemplate: Boolean,
+    ): CompletableFuture<RenderedIcon> {
+        if (iconSource == null) return MenuIconCache.render(iconRenderProperties, iconContent)
+        // Template icons are tinted natively, so the panel appearance does not change their pixels
+        val darkMode = !iconTemplate && trayManager?.isDarkMode == true
+        val key = MenuIconCache.Key(iconSource, iconTint, iconRenderProperties, darkMode)
+        return MenuIconCache.iconFor(key, iconContent)
     }
 
+    private fun CompletableFuture<RenderedIcon>.renderedOrNull(): RenderedIcon? =
+        if (isDone && !isCompletedExceptionally) join() else null
+
+    // Untinted vectors are template icons: rendered once for their shape, then tinted
+    // natively for the panel appearance, so a theme switch involves no Compose work.
+    private fun vectorIconContent(
+        icon: ImageVector,
+        iconTint: Color?,
+    ): @Composable () -> Unit =
+        {
+            Image(
+                imageVector = icon,
+                contentDescription = null,
+                modifier = Modifier.fillMaxSize(),
+                colorFilter = ColorFilter.tint(iconTint ?: Color.Black),
+            )
+        }
+
     override fun Divider() {
         lock.withLock {
             val divider = LinuxTrayManager.MenuItem(text = "-")
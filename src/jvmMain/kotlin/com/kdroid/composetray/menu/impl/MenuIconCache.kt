@@ -0,0 +1,66 @@
+package com.kdroid.composetray.menu.impl
+
+import androidx.compose.runtime.Composable
+import androidx.compose.ui.graphics.Color
+import com.kdroid.composetray.utils.ComposableIconUtils
+import com.kdroid.composetray.utils.IconRenderProperties
+import com.kdroid.composetray.utils.RenderedIcon
+import java.util.concurrent.CompletableFuture
+import java.util.concurrent.ExecutorService
+import java.util.concurrent.Executors
+
+/**
+ * Rendered menu item icons, kept across menu rebuilds.
+ *
+ * Entries are keyed by what an icon is drawn from rather than by its pixels, so rebuilding an
+ * unchanged menu renders nothing. Misses are rendered in parallel on a small pool; callers get
+ * a future and publish the menu without waiting for it.
+ *
+ * Composable content is never cached: it may read state, and a lambda's identity says nothing
+ * about what it draws. It is rendered on every build through [render] instead.
+ */
+internal object MenuIconCache {
+    private const val MAX_ENTRIES = 128
+    private val RENDER_THREADS = Runtime.getRuntime().availableProcessors().coerceIn(1, 4)
+
+    /**
+     * @property source the ImageVector, Painter or DrawableResource the icon is drawn from
+     * @property darkMode panel appearance, for icons that are not tinted natively
+     */
+    data class Key(
+        val source: Any,
+        val tint: Color?,
+        val properties: IconRenderProperties,
+        val darkMode: Boolean,
+    )
+
+    // Access-ordered, so the least recently used icon is evicted first
+    private val entries =
+        object : LinkedHashMap<Key, CompletableFuture<RenderedIcon>>(16, 0.75f, true) {
+            override fun removeEldestEntry(eldest: MutableMap.MutableEntry<Key, CompletableFuture<RenderedIcon>>) =
+                size > MAX_ENTRIES
+        }
+
+    private val renderPool: ExecutorService by lazy {
+        Executors.newFixedThreadPool(RENDER_THREADS) { task ->
+            Thread(task, "tray-menu-icons").apply { isDaemon = true }
+        }
+    }
+
+    /** The icon for [key], rendered from [content] on a miss; a failed render is retried on the next call. */
+    @Synchronized
+    fun iconFor(
+        key: Key,
+        content: @Composable () -> Unit,
+    ): CompletableFuture<RenderedIcon> {
+        entries[key]?.takeUnless { it.isCompletedExceptionally }?.let { return it }
+        return render(key.properties, content).also { entries[key] = it }
+    }
+
+    /** Renders [content] on the pool, bypassing the cache. */
+    fun render(
+        properties: IconRenderProperties,
+        content: @Composable () -> Unit,
+    ): CompletableFuture<RenderedIcon> =
+        CompletableFuture.supplyAsync({ ComposableIconUtils.renderComposableToIcon(properties, content) }, renderPool)
+}
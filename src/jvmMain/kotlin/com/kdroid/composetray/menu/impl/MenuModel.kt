@@ -0,0 +1,519 @@
+package com.kdroid.composetray.menu.impl
+
+import androidx.compose.runtime.Composable
+import androidx.compose.ui.graphics.Color
+import androidx.compose.ui.graphics.painter.Painter
+import androidx.compose.ui.graphics.vector.ImageVector
+import com.kdroid.composetray.menu.api.KeyShortcut
+import com.kdroid.composetray.menu.api.TrayMenuBuilder
+import com.kdroid.composetray.utils.IconRenderProperties
+import org.jetbrains.compose.resources.DrawableResource
+
+/**
+ * An immutable snapshot of a menu, captured by running the menu lambda once.
+ *
+ * The model is itself a menu lambda: invoking it on a platform builder replays the captured
+ * calls, so the user's code is not run a second time to build the native menu. [hash] is a
+ * structural 64-bit hash computed while capturing; equal menus hash equally.
+ */
+internal class MenuModel private constructor(
+    val nodes: List<MenuNode>,
+    val hash: Long,
+) : (TrayMenuBuilder) -> Unit {
+    override fun invoke(builder: TrayMenuBuilder) = nodes.forEach { it.replay(builder) }
+
+    companion object {
+        private const val FNV_OFFSET = -0x340d631b7bdddcdbL // 0xcbf29ce484222325
+        private const val FNV_PRIME = 0x100000001b3L
+
+        private const val KIND_ITEM = 1
+        private const val KIND_CHECKABLE = 2
+        private const val KIND_RADIO = 3
+        private const val KIND_SUBMENU = 4
+        private const val KIND_DIVIDER = 5
+
+        /** Runs [content] once against a recording builder. */
+        fun capture(content: TrayMenuBuilder.() -> Unit): MenuModel = Recorder().apply(content).toModel()
+    }
+
+    /** Icon of an item or submenu, kept as given so that each platform renders it its own way. */
+    sealed class MenuIcon(
+        val renderProperties: IconRenderProperties,
+    ) {
+        class Content(
+            val content: @Composable () -> Unit,
+            renderProperties: IconRenderProperties,
+        ) : MenuIcon(renderProperties)
+
+        class Vector(
+            val vector: ImageVector,
+            val tint: Color?,
+            renderProperties: IconRenderProperties,
+        ) : MenuIcon(renderProperties)
+
+        class PainterIcon(
+            val painter: Painter,
+            renderProperties: IconRenderProperties,
+        ) : MenuIcon(renderProperties)
+
+        class Drawable(
+            val resource: DrawableResource,
+            renderProperties: IconRenderProperties,
+        ) : MenuIcon(renderProperties)
+    }
+
+    sealed class MenuNode {
+        abstract fun replay(builder: TrayMenuBuilder)
+
+        class Item(
+            val label: String,
+            val icon: MenuIcon?,
+            val isEnabled: Boolean,
+            val shortcut: KeyShortcut?,
+            val onClick: () -> Unit,
+        ) : MenuNode() {
+            override fun replay(builder: TrayMenuBuilder) {
+                when (icon) {
+                    null -> builder.Item(label, isEnabled, shortcut, onClick)
+                    is MenuIcon.Content ->
+                        builder.Item(
+                            label,
+                            icon.content,
+                            icon.renderProperties,
+                            isEnabled,
+                            shortcut,
+                            onClick,
+                        )
+                    is MenuIcon.Vector ->
+                        builder.Item(label, icon.vector, icon.tint, icon.renderProperties, isEnabled, shortcut, onClick)
+                    is MenuIcon.PainterIcon ->
+                        builder.Item(
+                            label,
+                            icon.painter,
+                            icon.renderProperties,
+                            isEnabled,
+                            shortcut,
+                            onClick,
+                        )
+                    is MenuIcon.Drawable ->
+                        builder.Item(
+                            label,
+                            icon.resource,
+                            icon.renderProperties,
+                            isEnabled,
+                            shortcut,
+                            onClick,
+                        )
+                }
+            }
+        }
+
+        class CheckableItem(
+            val label: String,
+            val icon: MenuIcon?,
+            val checked: Boolean,
+            val onCheckedChange: (Boolean) -> Unit,
+            val isEnabled: Boolean,
+            val shortcut: KeyShortcut?,
+        ) : MenuNode() {
+            override fun replay(builder: TrayMenuBuilder) {
+                when (icon) {
+                    null -> builder.CheckableItem(label, checked, onCheckedChange, isEnabled, shortcut)
+                    is MenuIcon.Content ->
+                        builder.CheckableItem(
+                            label,
+                            icon.content,
+                            icon.renderProperties,
+                            checked,
+                            onCheckedChange,
+                            isEnabled,
+                            shortcut,
+                        )
+                    is MenuIcon.Vector ->
+                        builder.CheckableItem(
+                            label,
+                            icon.vector,
+                            icon.tint,
+                            icon.renderProperties,
+                            checked,
+                            onCheckedChange,
+                            isEnabled,
+                            shortcut,
+                        )
+                    is MenuIcon.PainterIcon ->
+                        builder.CheckableItem(
+                            label,
+                            icon.painter,
+                            icon.renderProperties,
+                            checked,
+                            onCheckedChange,
+                            isEnabled,
+                            shortcut,
+                        )
+                    is MenuIcon.Drawable ->
+                        builder.CheckableItem(
+                            label,
+                            icon.resource,
+                            icon.renderProperties,
+                            checked,
+                            onCheckedChange,
+                            isEnabled,
+                            shortcut,
+                        )
+                }
+            }
+        }
+
+        class RadioItem(
+            val label: String,
+            val group: String,
+            val selected: Boolean,
+            val onSelect: () -> Unit,
+            val isEnabled: Boolean,
+            val shortcut: KeyShortcut?,
+        ) : MenuNode() {
+            override fun replay(builder: TrayMenuBuilder) =
+                builder.RadioItem(label, group, selected, onSelect, isEnabled, shortcut)
+        }
+
+        class SubMenu(
+            val label: String,
+            val icon: MenuIcon?,
+            val isEnabled: Boolean,
+            // Null when the submenu was declared without content
+            val children: MenuModel?,
+        ) : MenuNode() {
+            override fun replay(builder: TrayMenuBuilder) {
+                when (icon) {
+                    null -> builder.SubMenu(label, isEnabled, children)
+                    is MenuIcon.Content ->
+                        builder.SubMenu(
+                            label,
+                            icon.content,
+                            icon.renderProperties,
+                            isEnabled,
+                            children,
+                        )
+                    is MenuIcon.Vector ->
+                        builder.SubMenu(
+                            label,
+                            icon.vector,
+                            icon.tint,
+                            icon.renderProperties,
+                            isEnabled,
+                            children,
+                        )
+                    is MenuIcon.PainterIcon ->
+                        builder.SubMenu(
+                            label,
+                            icon.painter,
+                            icon.renderProperties,
+                            isEnabled,
+                            children,
+                        )
+                    is MenuIcon.Drawable ->
+                        builder.SubMenu(
+                            label,
+                            icon.resource,
+                            icon.renderProperties,
+                            isEnabled,
+                            children,
+                        )
+                }
+            }
+        }
+
+        object Divider : MenuNode() {
+            override fun replay(builder: TrayMenuBuilder) = builder.Divider()
+        }
+    }
+
+    /** Records builder calls into nodes and folds each one into the hash as it arrives. */
+    private class Recorder : TrayMenuBuilder {
+        private val nodes = ArrayList<MenuNode>()
+        private var hash = FNV_OFFSET
+
+        private fun mix(value: Long) {
+            hash = (hash xor value) * FNV_PRIME
+        }
+
+        private fun mix(value: Int) = mix(value.toLong())
+
+        private fun mix(value: Boolean) = mix(if (value) 1L else 0L)
+
+        private fun mix(value: Any?) = mix(value?.hashCode() ?: 0)
+
+        // Every char, not String.hashCode(): 32 bits would make relabels like "Aa" -> "BB" collide
+        private fun mix(value: String) {
+            mix(value.length)
+            for (c in value) mix(c.code)
+        }
+
+        private fun mix(shortcut: KeyShortcut?) {
+            if (shortcut == null) return mix(0)
+            mix(1)
+            mix(shortcut.key.hashCode())
+            mix(shortcut.ctrl)
+            mix(shortcut.shift)
+            mix(shortcut.alt)
+            mix(shortcut.meta)
+        }
+
+        // Composable icon content is opaque: like the label, only its presence and kind count
+        private fun mixIcon(icon: MenuIcon?) {
+            when (icon) {
+                null -> mix(0)
+                is MenuIcon.Content -> mix(1)
+                is MenuIcon.Vector -> {
+                    mix(2)
+                    mix(icon.vector)
+                    mix(icon.tint != null)
+                }
+                is MenuIcon.PainterIcon -> {
+                    mix(3)
+                    mix(icon.painter)
+                }
+                is MenuIcon.Drawable -> {
+                    mix(4)
+                    mix(icon.resource)
+                }
+            }
+        }
+
+        private fun addItem(
+            label: String,
+            icon: MenuIcon?,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+            onClick: () -> Unit,
+        ) {
+            mix(KIND_ITEM)
+            mix(label)
+            mixIcon(icon)
+            mix(isEnabled)
+            mix(shortcut)
+            nodes += MenuNode.Item(label, icon, isEnabled, shortcut, onClick)
+        }
+
+        private fun addCheckable(
+            label: String,
+            icon: MenuIcon?,
+            checked: Boolean,
+            onCheckedChange: (Boolean) -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) {
+            mix(KIND_CHECKABLE)
+            mix(label)
+            mixIcon(icon)
+            mix(checked)
+            mix(isEnabled)
+            mix(shortcut)
+            nodes += MenuNode.CheckableItem(label, icon, checked, onCheckedChange, isEnabled, shortcut)
+        }
+
+        private fun addSubMenu(
+            label: String,
+            icon: MenuIcon?,
+            isEnabled: Boolean,
+            content: (TrayMenuBuilder.() -> Unit)?,
+        ) {
+            val children = content?.let(::capture)
+            mix(KIND_SUBMENU)
+            mix(label)
+            mixIcon(icon)
+            mix(isEnabled)
+            mix(children?.nodes?.size ?: -1)
+            mix(children?.hash ?: 0L)
+            nodes += MenuNode.SubMenu(label, icon, isEnabled, children)
+        }
+
+        fun toModel() = MenuModel(nodes.toList(), hash)
+
+        override fun Item(
+            label: String,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+            onClick: () -> Unit,
+        ) = addItem(label, null, isEnabled, shortcut, onClick)
+
+        override fun Item(
+            label: String,
+            iconContent: @Composable () -> Unit,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+            onClick: () -> Unit,
+        ) = addItem(label, MenuIcon.Content(iconContent, iconRenderProperties), isEnabled, shortcut, onClick)
+
+        override fun Item(
+            label: String,
+            icon: ImageVector,
+            iconTint: Color?,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+            onClick: () -> Unit,
+        ) = addItem(label, MenuIcon.Vector(icon, iconTint, iconRenderProperties), isEnabled, shortcut, onClick)
+
+        override fun Item(
+            label: String,
+            icon: Painter,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+            onClick: () -> Unit,
+        ) = addItem(label, MenuIcon.PainterIcon(icon, iconRenderProperties), isEnabled, shortcut, onClick)
+
+        override fun Item(
+            label: String,
+            icon: DrawableResource,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+            onClick: () -> Unit,
+        ) = addItem(label, MenuIcon.Drawable(icon, iconRenderProperties), isEnabled, shortcut, onClick)
+
+        override fun CheckableItem(
+            label: String,
+            checked: Boolean,
+            onCheckedChange: (Boolean) -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) = addCheckable(label, null, checked, onCheckedChange, isEnabled, shortcut)
+
+        override fun CheckableItem(
+            label: String,
+            iconContent: @Composable () -> Unit,
+            iconRenderProperties: IconRenderProperties,
+            checked: Boolean,
+            onCheckedChange: (Boolean) -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) = addCheckable(
+            label,
+            MenuIcon.Content(iconContent, iconRenderProperties),
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+        )
+
+        override fun CheckableItem(
+            label: String,
+            icon: ImageVector,
+            iconTint: Color?,
+            iconRenderProperties: IconRenderProperties,
+            checked: Boolean,
+            onCheckedChange: (Boolean) -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) = addCheckable(
+            label,
+            MenuIcon.Vector(icon, iconTint, iconRenderProperties),
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+        )
+
+        override fun CheckableItem(
+            label: String,
+            icon: Painter,
+            iconRenderProperties: IconRenderProperties,
+            checked: Boolean,
+            onCheckedChange: (Boolean) -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) = addCheckable(
+            label,
+            MenuIcon.PainterIcon(icon, iconRenderProperties),
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+        )
+
+        override fun CheckableItem(
+            label: String,
+            icon: DrawableResource,
+            iconRenderProperties: IconRenderProperties,
+            checked: Boolean,
+            onCheckedChange: (Boolean) -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) = addCheckable(
+            label,
+            MenuIcon.Drawable(icon, iconRenderProperties),
+            checked,
+            onCheckedChange,
+            isEnabled,
+            shortcut,
+        )
+
+        override fun RadioItem(
+            label: String,
+            group: String,
+            selected: Boolean,
+            onSelect: () -> Unit,
+            isEnabled: Boolean,
+            shortcut: KeyShortcut?,
+        ) {
+            mix(KIND_RADIO)
+            mix(label)
+            mix(group)
+            mix(selected)
+            mix(isEnabled)
+            mix(shortcut)
+            nodes += MenuNode.RadioItem(label, group, selected, onSelect, isEnabled, shortcut)
+        }
+
+        override fun SubMenu(
+            label: String,
+            isEnabled: Boolean,
+            submenuContent: (TrayMenuBuilder.() -> Unit)?,
+        ) = addSubMenu(label, null, isEnabled, submenuContent)
+
+        override fun SubMenu(
+            label: String,
+            iconContent: @Composable () -> Unit,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            submenuContent: (TrayMenuBuilder.() -> Unit)?,
+        ) = addSubMenu(label, MenuIcon.Content(iconContent, iconRenderProperties), isEnabled, submenuContent)
+
+        override fun SubMenu(
+            label: String,
+            icon: ImageVector,
+            iconTint: Color?,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            submenuContent: (TrayMenuBuilder.() -> Unit)?,
+        ) = addSubMenu(label, MenuIcon.Vector(icon, iconTint, iconRenderProperties), isEnabled, submenuContent)
+
+        override fun SubMenu(
+            label: String,
+            icon: Painter,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            submenuContent: (TrayMenuBuilder.() -> Unit)?,
+        ) = addSubMenu(label, MenuIcon.PainterIcon(icon, iconRenderProperties), isEnabled, submenuContent)
+
+        override fun SubMenu(
+            label: String,
+            icon: DrawableResource,
+            iconRenderProperties: IconRenderProperties,
+            isEnabled: Boolean,
+            submenuContent: (TrayMenuBuilder.() -> Unit)?,
+        ) = addSubMenu(label, MenuIcon.Drawable(icon, iconRenderProperties), isEnabled, submenuContent)
+
+        override fun Divider() {
+            mix(KIND_DIVIDER)
+            nodes += MenuNode.Divider
+        }
+
+        override fun dispose() {
+            // Nothing is held: the recorded nodes belong to the model
+        }
+    }
+}
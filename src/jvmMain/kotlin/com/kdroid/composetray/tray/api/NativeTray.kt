@@ -15,10 +15,13 @@ import com.kdroid.composetray.menu.api.TrayMenuBuilder
 import com.kdroid.composetray.tray.impl.AwtTrayInitializer
 import com.kdroid.composetray.tray.impl.LinuxTrayInitializer
 import com.kdroid.composetray.tray.impl.MacTrayInitializer
+import com.kdroid.composetray.tray.impl.TrayUpdateActor
+import com.kdroid.composetray.tray.impl.TrayUpdateStats
 import com.kdroid.composetray.tray.impl.WindowsTrayInitializer
 import com.kdroid.composetray.utils.ComposableIconUtils
 import com.kdroid.composetray.utils.IconRenderProperties
 import com.kdroid.composetray.utils.MenuContentHash
+import com.kdroid.composetray.utils.RenderedIcon
 import com.kdroid.composetray.utils.debugln
 import com.kdroid.composetray.utils.errorln
 import com.kdroid.composetray.utils.extractToTempIfDifferent
@@ -29,11 +32,12 @@ import io.github.kdroidfilter.platformtools.OperatingSystem.MACOS
 import io.github.kdroidfilter.platformtools.OperatingSystem.UNKNOWN
 import io.github.kdroidfilter.platformtools.OperatingSystem.WINDOWS
 import io.github.kdroidfilter.platformtools.getOperatingSystem
+import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.SupervisorJob
 import kotlinx.coroutines.delay
-import kotlinx.coroutines.launch
+import kotlinx.coroutines.ensureActive
 import org.jetbrains.compose.resources.DrawableResource
 import org.jetbrains.compose.resources.painterResource
 import java.util.concurrent.atomic.AtomicBoolean
@@ -45,11 +49,24 @@ internal class NativeTray {
 
     private val os = getOperatingSystem()
     private val instanceId: String = "tray-" + System.identityHashCode(this)
-    private var initialized = false
+
+    // Newest update wins: stale renders are cancelled and never reach the native tray
+    private val updates = TrayUpdateActor(trayScope)
+
+    // Held around every native apply and by dispose(), which thus waits for one in progress
+    private val nativeLock = Any()
+
+    @Volatile private var initialized = false
+
+    // Bumped by dispose(): updates submitted before it must not bring the tray back
+    @Volatile private var generation = 0
 
     // Expose the unique instance key so UI code (TrayApp) can compute per-instance positions
     fun instanceKey(): String = instanceId
 
+    /** Updates applied and dropped as superseded so far. */
+    fun updateStats(): TrayUpdateStats = updates.stats()
+
     fun update(
         iconPath: String,
         windowsIconPath: String = iconPath,
@@ -58,10 +75,29 @@ internal class NativeTray {
         menuContent: (TrayMenuBuilder.() -> Unit)?,
         onMenuOpened: (() -> Unit)? = null,
     ) {
+        val submitted = generation
+        updates.submit {
+            applyUpdate(submitted, iconPath, windowsIconPath, tooltip, primaryAction, menuContent, onMenuOpened)
+        }
+    }
+
+    /**
+     * Creates the tray on the first call and updates it afterwards, unless this update was
+     * cancelled or the tray disposed since [submitted].
+     */
+    private fun CoroutineScope.applyUpdate(
+        submitted: Int,
+        iconPath: String,
+        windowsIconPath: String,
+        tooltip: String,
+        primaryAction: (() -> Unit)?,
+        menuContent: (TrayMenuBuilder.() -> Unit)?,
+        onMenuOpened: (() -> Unit)?,
+    ) = withNative(submitted) {
         if (!initialized) {
-            initializeTray(iconPath, windowsIconPath, tooltip, primaryAction, menuContent)
+            initializeTray(iconPath, windowsIconPath, tooltip, primaryAction, menuContent, onMenuOpened)
             initialized = true
-            return
+            return@withNative
         }
 
         try {
@@ -104,12 +140,25 @@ internal class NativeTray {
         }
     }
 
+    // The last cancellation point of an update: past it, its native calls run to the end
+    private inline fun CoroutineScope.withNative(
+        submitted: Int,
+        block: () -> Unit,
+    ) {
+        synchronized(nativeLock) {
+            ensureActive()
+            if (submitted == generation) block()
+        }
+    }
+
     /**
      * New update path: render the composable icon to PNG/ICO with retries and then update/init the tray.
      * If rendering keeps failing, we log and **do not create/update** the tray (never crash the app).
      *
      * @param lightIconContent Optional composable for the light-appearance icon (macOS only).
      * @param darkIconContent Optional composable for the dark-appearance icon (macOS only).
+     * @param renderedIcon [iconContent] already rendered by the caller (usually to hash it);
+     *   used as the first attempt instead of rendering the same frame again.
      */
     fun updateComposable(
         iconContent: @Composable () -> Unit,
@@ -122,73 +171,36 @@ internal class NativeTray {
         lightIconContent: (@Composable () -> Unit)? = null,
         darkIconContent: (@Composable () -> Unit)? = null,
         onMenuOpened: (() -> Unit)? = null,
+        renderedIcon: RenderedIcon? = null,
     ) {
-        trayScope.launch {
-            val rendered = renderIconsWithRetry(iconContent, iconRenderProperties, maxAttempts, backoffMs)
+        val submitted = generation
+        updates.submit {
+            val rendered =
+                renderIconsWithRetry(iconContent, iconRenderProperties, maxAttempts, backoffMs, renderedIcon)
             if (rendered == null) {
                 errorln {
                     "[NativeTray] Icon rendering failed after $maxAttempts attempts. " +
                         "Tray will not be created/updated."
                 }
-                return@launch
+                return@submit
             }
 
             val (pngIconPath, windowsIconPath) = rendered
-
-            if (!initialized) {
-                initializeTray(pngIconPath, windowsIconPath, tooltip, primaryAction, menuContent, onMenuOpened)
-                initialized = true
-            } else {
-                try {
-                    when (os) {
-                        LINUX ->
-                            LinuxTrayInitializer.update(
-                                instanceId,
-                                pngIconPath,
-                                tooltip,
-                                primaryAction,
-                                menuContent,
-                                onMenuOpened,
-                            )
-                        WINDOWS ->
-                            WindowsTrayInitializer.update(
-                                instanceId,
-                                windowsIconPath,
-                                tooltip,
-                                primaryAction,
-                                menuContent,
-                                onMenuOpened,
-                            )
-                        MACOS ->
-                            MacTrayInitializer.update(
-                                instanceId,
-                                pngIconPath,
-                                tooltip,
-                                primaryAction,
-                                menuContent,
-                                onMenuOpened,
-                            )
-                        UNKNOWN -> {
-                            AwtTrayInitializer.update(pngIconPath, tooltip, primaryAction, menuContent)
-                            awtTrayUsed.set(true)
-                        }
-                        else -> {}
-                    }
-                } catch (th: Throwable) {
-                    errorln { "[NativeTray] Error updating tray after successful render: $th" }
-                }
-            }
+            applyUpdate(submitted, pngIconPath, windowsIconPath, tooltip, primaryAction, menuContent, onMenuOpened)
 
             // On macOS, pre-render light/dark variants for instant appearance switching
             if (os == MACOS && lightIconContent != null && darkIconContent != null) {
                 try {
+                    ensureActive()
                     val lightPath =
                         ComposableIconUtils.renderComposableToPngFile(
                             iconRenderProperties,
                             lightIconContent,
                         )
                     val darkPath = ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, darkIconContent)
-                    MacTrayInitializer.setAppearanceIcons(instanceId, lightPath, darkPath)
+                    withNative(submitted) { MacTrayInitializer.setAppearanceIcons(instanceId, lightPath, darkPath) }
+                } catch (e: CancellationException) {
+                    throw e
                 } catch (th: Throwable) {
                     errorln { "[NativeTray] Failed to render appearance icons: $th" }
                 }
@@ -196,6 +208,19 @@ internal class NativeTray {
         }
     }
 
+    /**
+     * Push the panel appearance on Linux, where template icons (see [templateIcon] and untinted
+     * `ImageVector` menu icons) are re-tinted natively instead of being re-rendered.
+     */
+    fun setLinuxAppearance(
+        isDark: Boolean,
+        templateIcon: Boolean,
+    ) {
+        if (os != LINUX) return
+        LinuxTrayInitializer.setIconTemplate(instanceId, templateIcon)
+        LinuxTrayInitializer.setDarkMode(instanceId, isDark)
+    }
+
     /**
      * Set macOS appearance icons directly from file paths.
      */
@@ -213,26 +238,31 @@ internal class NativeTray {
         iconRenderProperties: IconRenderProperties,
         maxAttempts: Int,
         backoffMs: Long,
+        prerendered: RenderedIcon?,
     ): Pair<String, String>? {
         var attempt = 0
         while (attempt < maxAttempts) {
             try {
-                // Render the composable to PNG for general platforms
-                val pngIconPath = ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
-
-                // On Windows, also render to ICO; on other OSes reuse PNG path
-                val windowsIconPath =
-                    if (os == WINDOWS) {
-                        ComposableIconUtils.renderComposableToIcoFile(iconRenderProperties, iconContent)
+                // Render once; PNG and ICO are both encoded from the same pixels
+                val icon =
+                    if (attempt == 0 && prerendered != null) {
+                        prerendered
                     } else {
-                        pngIconPath
+                        ComposableIconUtils.renderComposableToIcon(iconRenderProperties, iconContent)
                     }
+                // Linux gets an in-memory key; other platforms a file shared by identical renders
+                val pngIconPath = ComposableIconUtils.trayIconPath(icon)
+
+                // On Windows, also write an ICO; on other OSes reuse PNG path
+                val windowsIconPath = if (os == WINDOWS) ComposableIconUtils.writeIcoFile(icon) else pngIconPath
 
                 debugln {
                     "[NativeTray] Rendered tray icons (attempt ${attempt + 1}/$maxAttempts): " +
                         "PNG=$pngIconPath, WIN=$windowsIconPath"
                 }
                 return pngIconPath to windowsIconPath
+            } catch (e: CancellationException) {
+                throw e
             } catch (e: Throwable) {
                 errorln {
                     "[NativeTray] Icon render attempt ${attempt + 1} failed: " +
@@ -246,14 +276,18 @@ internal class NativeTray {
     }
 
     fun dispose() {
-        when (os) {
-            LINUX -> LinuxTrayInitializer.dispose(instanceId)
-            WINDOWS -> WindowsTrayInitializer.dispose(instanceId)
-            MACOS -> MacTrayInitializer.dispose(instanceId)
-            UNKNOWN -> if (awtTrayUsed.get()) AwtTrayInitializer.dispose()
-            else -> {}
+        updates.clear()
+        synchronized(nativeLock) {
+            generation++
+            when (os) {
+                LINUX -> LinuxTrayInitializer.dispose(instanceId)
+                WINDOWS -> WindowsTrayInitializer.dispose(instanceId)
+                MACOS -> MacTrayInitializer.dispose(instanceId)
+                UNKNOWN -> if (awtTrayUsed.get()) AwtTrayInitializer.dispose()
+                else -> {}
+            }
+            initialized = false
         }
-        initialized = false
     }
 
     /**
@@ -272,66 +306,64 @@ internal class NativeTray {
         menuContent: (TrayMenuBuilder.() -> Unit)? = null,
         onMenuOpened: (() -> Unit)? = null,
     ) {
-        trayScope.launch {
-            var trayInitialized = false
-            val os = getOperatingSystem()
-            try {
-                when (os) {
-                    LINUX -> {
-                        debugln { "[NativeTray] Initializing Linux tray with icon path: $iconPath" }
-                        LinuxTrayInitializer.initialize(
-                            instanceId,
-                            iconPath,
-                            tooltip,
-                            primaryAction,
-                            menuContent,
-                            onMenuOpened,
-                        )
-                        trayInitialized = true
-                    }
-                    WINDOWS -> {
-                        debugln { "[NativeTray] Initializing Windows tray with icon path: $windowsIconPath" }
-                        WindowsTrayInitializer.initialize(
-                            instanceId,
-                            windowsIconPath,
-                            tooltip,
-                            primaryAction,
-                            menuContent,
-                            onMenuOpened,
-                        )
-                        trayInitialized = true
-                    }
-                    MACOS -> {
-                        debugln { "[NativeTray] Initializing macOS tray with icon path: $iconPath" }
-                        MacTrayInitializer.initialize(
-                            instanceId,
-                            iconPath,
-                            tooltip,
-                            primaryAction,
-                            menuContent,
-                            onMenuOpened,
-                        )
-                        trayInitialized = true
-                    }
-                    else -> {}
+        var trayInitialized = false
+        val os = getOperatingSystem()
+        try {
+            when (os) {
+                LINUX -> {
+                    debugln { "[NativeTray] Initializing Linux tray with icon path: $iconPath" }
+                    LinuxTrayInitializer.initialize(
+                        instanceId,
+                        iconPath,
+                        tooltip,
+                        primaryAction,
+                        menuContent,
+                        onMenuOpened,
+                    )
+                    trayInitialized = true
+                }
+                WINDOWS -> {
+                    debugln { "[NativeTray] Initializing Windows tray with icon path: $windowsIconPath" }
+                    WindowsTrayInitializer.initialize(
+                        instanceId,
+                        windowsIconPath,
+                        tooltip,
+                        primaryAction,
+                        menuContent,
+                        onMenuOpened,
+                    )
+                    trayInitialized = true
+                }
+                MACOS -> {
+                    debugln { "[NativeTray] Initializing macOS tray with icon path: $iconPath" }
+                    MacTrayInitializer.initialize(
+                        instanceId,
+                        iconPath,
+                        tooltip,
+                        primaryAction,
+                        menuContent,
+                        onMenuOpened,
+                    )
+                    trayInitialized = true
                 }
-            } catch (th: Throwable) {
-                errorln { "[NativeTray] Error initializing tray: $th" }
+                else -> {}
             }
+        } catch (th: Throwable) {
+            errorln { "[NativeTray] Error initializing tray: $th" }
+        }
 
-            val awtTrayRequired = os == UNKNOWN || !trayInitialized
-            if (awtTrayRequired) {
-                if (AwtTrayInitializer.isSupported()) {
-                    try {
-                        debugln { "[NativeTray] Initializing AWT tray with icon path: $iconPath" }
-                        AwtTrayInitializer.initialize(iconPath, tooltip, primaryAction, menuContent)
-                        awtTrayUsed.set(true)
-                    } catch (th: Throwable) {
-                        errorln { "[NativeTray] Error initializing AWT tray: $th" }
-                    }
-                } else {
-                    debugln { "[NativeTray] AWT tray is not supported" }
+        val awtTrayRequired = os == UNKNOWN || !trayInitialized
+        if (awtTrayRequired) {
+            if (AwtTrayInitializer.isSupported()) {
+                try {
+                    debugln { "[NativeTray] Initializing AWT tray with icon path: $iconPath" }
+                    AwtTrayInitializer.initialize(iconPath, tooltip, primaryAction, menuContent)
+                    awtTrayUsed.set(true)
+                } catch (th: Throwable) {
+                    errorln { "[NativeTray] Error initializing AWT tray: $th" }
                 }
+            } else {
+                debugln { "[NativeTray] AWT tray is not supported" }
             }
         }
     }
@@ -387,12 +419,12 @@ fun ApplicationScope.Tray(
 
     val tray = remember { NativeTray() }
 
-    // Calculate menu hash to detect changes
-    val menuHash = MenuContentHash.calculateMenuHash(menuContent)
+    // Capture the menu once: its hash detects changes and the same model builds the native menu
+    val menuModel = MenuContentHash.captureMenu(menuContent)
 
-    // Update when params change, including menuHash
-    LaunchedEffect(absoluteIconPath, absoluteWindowsIconPath, tooltip, primaryAction, menuContent, menuHash) {
-        tray.update(absoluteIconPath, absoluteWindowsIconPath, tooltip, primaryAction, menuContent, onMenuOpened)
+    // Update when params change, including the menu hash
+    LaunchedEffect(absoluteIconPath, absoluteWindowsIconPath, tooltip, primaryAction, menuContent, menuModel?.hash) {
+        tray.update(absoluteIconPath, absoluteWindowsIconPath, tooltip, primaryAction, menuModel, onMenuOpened)
     }
 
     // Dispose only when Tray is removed from composition
@@ -415,25 +447,29 @@ fun ApplicationScope.Tray(
 ) {
     val isDark = isMenuBarInDarkMode() // Observe menu bar theme to trigger recomposition on changes
 
-    // Calculate a hash of the rendered composable content to detect changes, including theme state
-    val contentHash = ComposableIconUtils.calculateContentHash(iconRenderProperties, iconContent) + isDark.hashCode()
+    // Render once per recomposition; the pixels' hash detects changes and the same frame is uploaded
+    val renderedIcon = ComposableIconUtils.renderComposableToIconOrNull(iconRenderProperties, iconContent)
+    val contentHash = (renderedIcon?.contentHash ?: System.currentTimeMillis()) + isDark.hashCode()
 
-    // Calculate a hash of the menu content to detect changes
-    val menuHash = MenuContentHash.calculateMenuHash(menuContent)
+    // Capture the menu once: its hash detects changes and the same model builds the native menu
+    val menuModel = MenuContentHash.captureMenu(menuContent)
 
     val tray = remember { NativeTray() }
 
+    LaunchedEffect(isDark) { tray.setLinuxAppearance(isDark, templateIcon = false) }
+
     // On any content/menu change, delegate to retry-safe path
-    LaunchedEffect(contentHash, tooltip, primaryAction, menuContent, menuHash) {
+    LaunchedEffect(contentHash, tooltip, primaryAction, menuContent, menuModel?.hash) {
         tray.updateComposable(
             iconContent = iconContent,
             iconRenderProperties = iconRenderProperties,
             tooltip = tooltip,
             primaryAction = primaryAction,
-            menuContent = menuContent,
+            menuContent = menuModel,
             maxAttempts = 3,
             backoffMs = 200,
             onMenuOpened = onMenuOpened,
+            renderedIcon = renderedIcon,
         )
     }
 
@@ -459,6 +495,10 @@ fun ApplicationScope.Tray(
     val isSystemInDarkTheme = isSystemInDarkMode()
     val isMacOS = getOperatingSystem() == MACOS
 
+    // On Linux an untinted vector is a template icon: rendered once as a shape and
+    // tinted natively, so a theme switch does not render anything
+    val linuxTemplate = tint == null && getOperatingSystem() == LINUX
+
     // Define the icon content lambda
     val iconContent: @Composable () -> Unit = {
         Image(
@@ -467,7 +507,7 @@ fun ApplicationScope.Tray(
             modifier = Modifier.fillMaxSize(),
             colorFilter =
                 tint?.let { androidx.compose.ui.graphics.ColorFilter.tint(it) }
-                    ?: if (isDark) {
+                    ?: if (isDark && !linuxTemplate) {
                         androidx.compose.ui.graphics.ColorFilter.tint(Color.White)
                     } else {
                         androidx.compose.ui.graphics.ColorFilter.tint(Color.Black)
@@ -504,31 +544,41 @@ fun ApplicationScope.Tray(
             null
         }
 
-    // Calculate menu hash to detect changes
-    val menuHash = MenuContentHash.calculateMenuHash(menuContent)
+    // Capture the menu once: its hash detects changes and the same model builds the native menu
+    val menuModel = MenuContentHash.captureMenu(menuContent)
 
-    // Updated contentHash to include icon and tint for proper recomposition on changes
+    // Updated contentHash to include icon and tint for proper recomposition on changes.
+    // The vector, tint and appearance fully determine the pixels, so only render for a new key.
+    val appearanceKey = if (linuxTemplate) null else isDark to isSystemInDarkTheme
+    val renderedIcon =
+        remember(icon, tint, iconRenderProperties, appearanceKey) {
+            ComposableIconUtils.renderComposableToIconOrNull(iconRenderProperties, iconContent)
+        }
     val contentHash =
-        ComposableIconUtils.calculateContentHash(iconRenderProperties, iconContent) +
-            isDark.hashCode() +
-            isSystemInDarkTheme.hashCode() +
-            icon.hashCode() +
-            (tint?.hashCode() ?: 0)
+        remember(renderedIcon) {
+            (renderedIcon?.contentHash ?: System.currentTimeMillis()) +
+                appearanceKey.hashCode() +
+                icon.hashCode() +
+                (tint?.hashCode() ?: 0)
+        }
 
     val tray = remember { NativeTray() }
 
-    LaunchedEffect(contentHash, tooltip, primaryAction, menuContent, menuHash) {
+    LaunchedEffect(isDark) { tray.setLinuxAppearance(isDark, templateIcon = linuxTemplate) }
+
+    LaunchedEffect(contentHash, tooltip, primaryAction, menuContent, menuModel?.hash) {
         tray.updateComposable(
             iconContent = iconContent,
             iconRenderProperties = iconRenderProperties,
             tooltip = tooltip,
             primaryAction = primaryAction,
-            menuContent = menuContent,
+            menuContent = menuModel,
             maxAttempts = 3,
             backoffMs = 200,
             lightIconContent = lightIconContent,
             darkIconContent = darkIconContent,
             onMenuOpened = onMenuOpened,
+            renderedIcon = renderedIcon,
         )
     }
 
@@ -560,27 +610,32 @@ fun ApplicationScope.Tray(
         )
     }
 
-    // Calculate menu hash to detect changes
-    val menuHash = MenuContentHash.calculateMenuHash(menuContent)
+    // Capture the menu once: its hash detects changes and the same model builds the native menu
+    val menuModel = MenuContentHash.captureMenu(menuContent)
 
-    // Updated contentHash to include icon for proper recomposition on changes
+    // Updated contentHash to include icon for proper recomposition on changes. On Linux the
+    // menu's vector icons follow the theme natively, so the theme is not part of the key there.
+    val renderedIcon = ComposableIconUtils.renderComposableToIconOrNull(iconRenderProperties, iconContent)
     val contentHash =
-        ComposableIconUtils.calculateContentHash(iconRenderProperties, iconContent) +
-            isDark.hashCode() +
+        (renderedIcon?.contentHash ?: System.currentTimeMillis()) +
+            (if (getOperatingSystem() == LINUX) 0 else isDark.hashCode()) +
             icon.hashCode()
 
     val tray = remember { NativeTray() }
 
-    LaunchedEffect(contentHash, tooltip, primaryAction, menuContent, menuHash) {
+    LaunchedEffect(isDark) { tray.setLinuxAppearance(isDark, templateIcon = false) }
+
+    LaunchedEffect(contentHash, tooltip, primaryAction, menuContent, menuModel?.hash) {
         tray.updateComposable(
             iconContent = iconContent,
             iconRenderProperties = iconRenderProperties,
             tooltip = tooltip,
             primaryAction = primaryAction,
-            menuContent = menuContent,
+            menuContent = menuModel,
             maxAttempts = 3,
             backoffMs = 200,
             onMenuOpened = onMenuOpened,
+            renderedIcon = renderedIcon,
         )
     }
 
@@ -532,23 +532,25 @@ private fun ApplicationScope.TrayAppImplOriginal(
 
     val tray = remember { NativeTray() }
     val isDark = isMenuBarInDarkMode()
-    val contentHash = ComposableIconUtils.calculateContentHash(iconRenderProperties, iconContent) + isDark.hashCode()
+    // Rendered once: hashed here, then encoded from the same pixels when it changed
+    val renderedIcon = ComposableIconUtils.renderComposableToIconOrNull(iconRenderProperties, iconContent)
+    val contentHash = (renderedIcon?.contentHash ?: System.currentTimeMillis()) + isDark.hashCode()
+    LaunchedEffect(isDark) { tray.setLinuxAppearance(isDark, templateIcon = false) }
     val pngIconPath =
         remember(contentHash) {
-            ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
+            renderedIcon?.let(ComposableIconUtils::trayIconPath)
+                ?: ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
         }
     val windowsIconPath =
         remember(contentHash) {
             if (getOperatingSystem() == WINDOWS) {
-                ComposableIconUtils.renderComposableToIcoFile(
-                    iconRenderProperties,
-                    iconContent,
-                )
+                renderedIcon?.let(ComposableIconUtils::writeIcoFile)
+                    ?: ComposableIconUtils.renderComposableToIcoFile(iconRenderProperties, iconContent)
             } else {
                 pngIconPath
             }
         }
-    val menuHash = MenuContentHash.calculateMenuHash(menu)
+    val menuModel = MenuContentHash.captureMenu(menu)
 
     var shouldShowWindow by remember { mutableStateOf(false) }
 
@@ -745,8 +747,8 @@ private fun ApplicationScope.TrayAppImplOriginal(
         }
     }
 
-    LaunchedEffect(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menu, contentHash, menuHash) {
-        tray.update(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menu)
+    LaunchedEffect(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menu, contentHash, menuModel?.hash) {
+        tray.update(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menuModel)
     }
 
     LaunchedEffect(Unit) {
@@ -942,11 +944,16 @@ private fun ApplicationScope.TrayAppImplLinux(
     val instanceKey = remember { tray.instanceKey() }
 
     val isDark = isMenuBarInDarkMode()
-    val contentHash = ComposableIconUtils.calculateContentHash(iconRenderProperties, iconContent) + isDark.hashCode()
+    val renderedIcon = ComposableIconUtils.renderComposableToIconOrNull(iconRenderProperties, iconContent)
+    val contentHash = (renderedIcon?.contentHash ?: System.currentTimeMillis()) + isDark.hashCode()
     val pngIconPath =
-        remember(contentHash) { ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent) }
+        remember(contentHash) {
+            renderedIcon?.let(ComposableIconUtils::trayIconPath)
+                ?: ComposableIconUtils.renderComposableToPngFile(iconRenderProperties, iconContent)
+        }
+    LaunchedEffect(isDark) { tray.setLinuxAppearance(isDark, templateIcon = false) }
     val windowsIconPath = pngIconPath
-    val menuHash = MenuContentHash.calculateMenuHash(menu)
+    val menuModel = MenuContentHash.captureMenu(menu)
 
     var shouldShowWindow by remember { mutableStateOf(false) }
     var lastPrimaryActionAt by remember { mutableStateOf(0L) }
@@ -1026,8 +1033,8 @@ private fun ApplicationScope.TrayAppImplLinux(
         }
     }
 
-    LaunchedEffect(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menu, contentHash, menuHash) {
-        tray.update(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menu)
+    LaunchedEffect(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menu, contentHash, menuModel?.hash) {
+        tray.update(pngIconPath, windowsIconPath, tooltip, internalPrimaryAction, menuModel)
     }
 
     DisposableEffect(Unit) { onDispose { tray.dispose() } }
@@ -0,0 +1,7 @@
+package com.kdroid.composetray.tray.api
+
+/** Axis of a scroll gesture over the tray icon. */
+enum class TrayScrollOrientation {
+    VERTICAL,
+    HORIZONTAL,
+}
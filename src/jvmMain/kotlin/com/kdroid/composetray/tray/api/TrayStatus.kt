@@ -0,0 +1,16 @@
+package com.kdroid.composetray.tray.api
+
+/**
+ * Visibility state of a tray icon, mapped to the StatusNotifierItem `Status` on Linux.
+ * Switching status keeps the tray registered, so it is far cheaper than disposing it.
+ */
+enum class TrayStatus {
+    /** Hidden, or moved to the overflow area, depending on the desktop. */
+    PASSIVE,
+
+    /** Shown normally. */
+    ACTIVE,
+
+    /** Shown with the attention icon, when one is set. */
+    NEEDS_ATTENTION,
+}
@@ -3,6 +3,8 @@ package com.kdroid.composetray.tray.impl
 import com.kdroid.composetray.lib.linux.LinuxTrayManager
 import com.kdroid.composetray.menu.api.TrayMenuBuilder
 import com.kdroid.composetray.menu.impl.LinuxTrayMenuBuilderImpl
+import com.kdroid.composetray.tray.api.TrayScrollOrientation
+import com.kdroid.composetray.tray.api.TrayStatus
 import java.util.concurrent.locks.ReentrantLock
 import kotlin.concurrent.withLock
 
@@ -13,6 +15,17 @@ object LinuxTrayInitializer {
     private val linuxTrayManagers: MutableMap<String, LinuxTrayManager> = mutableMapOf()
     private val lock = ReentrantLock()
 
+    // Appearance may be pushed before the tray exists; it is applied when the tray starts
+    private val darkModes: MutableMap<String, Boolean> = mutableMapOf()
+    private val iconTemplates: MutableMap<String, Boolean> = mutableMapOf()
+    private val statuses: MutableMap<String, TrayStatus> = mutableMapOf()
+    private val attentionIcons: MutableMap<String, String?> = mutableMapOf()
+    private val scrollListeners: MutableMap<String, (Int, TrayScrollOrientation) -> Unit> = mutableMapOf()
+    private val doubleClickListeners: MutableMap<String, () -> Unit> = mutableMapOf()
+    private val deferSingleClicks: MutableMap<String, Boolean> = mutableMapOf()
+    private val middleClickListeners: MutableMap<String, () -> Unit> = mutableMapOf()
+    private val hostListeners: MutableMap<String, (Boolean) -> Unit> = mutableMapOf()
+
     @Synchronized
     fun initialize(
         id: String,
@@ -27,6 +40,15 @@ object LinuxTrayInitializer {
             if (existing == null) {
                 val manager = LinuxTrayManager(id, iconPath, tooltip, onLeftClick, onMenuOpened)
                 linuxTrayManagers[id] = manager
+                darkModes[id]?.let(manager::setDarkMode)
+                iconTemplates[id]?.let(manager::setIconTemplate)
+                statuses[id]?.let(manager::setStatus)
+                if (id in attentionIcons) manager.setAttentionIcon(attentionIcons[id])
+                manager.onScroll = scrollListeners[id]
+                manager.onDoubleClick = doubleClickListeners[id]
+                deferSingleClicks[id]?.let(manager::setDeferSingleClick)
+                manager.onMiddleClick = middleClickListeners[id]
+                manager.onHostPresenceChanged = hostListeners[id]
 
                 val menuImpl =
                     if (menuContent != null) {
@@ -82,6 +104,154 @@ object LinuxTrayInitializer {
         }
     }
 
+    /**
+     * Panel appearance for template icons (the tray icon in template mode and untinted
+     * `ImageVector` menu icons). They are re-tinted natively, without re-rendering.
+     */
+    fun setDarkMode(
+        id: String,
+        isDark: Boolean,
+    ) {
+        lock.withLock {
+            darkModes[id] = isDark
+            linuxTrayManagers[id]?.setDarkMode(isDark)
+        }
+    }
+
+    /** Treat the tray icon as a template: only its alpha is kept and it follows [setDarkMode]. */
+    fun setIconTemplate(
+        id: String,
+        enabled: Boolean,
+    ) {
+        lock.withLock {
+            iconTemplates[id] = enabled
+            linuxTrayManagers[id]?.setIconTemplate(enabled)
+        }
+    }
+
+    /**
+     * Hide ([TrayStatus.PASSIVE]), show or alert without tearing the tray down.
+     * Each change is a single D-Bus signal; the tray stays registered.
+     */
+    fun setStatus(
+        id: String,
+        status: TrayStatus,
+    ) {
+        lock.withLock {
+            statuses[id] = status
+            linuxTrayManagers[id]?.setStatus(status)
+        }
+    }
+
+    /**
+     * Icon shown while the status is [TrayStatus.NEEDS_ATTENTION] (null to clear). It is
+     * decoded when set, so raising the alert later costs one signal.
+     */
+    fun setAttentionIcon(
+        id: String,
+        iconPath: String?,
+    ) {
+        lock.withLock {
+            attentionIcons[id] = iconPath
+            linuxTrayManagers[id]?.setAttentionIcon(iconPath)
+        }
+    }
+
+    /**
+     * Receive wheel and touchpad scrolling over the tray icon (null to stop). Deltas are
+     * summed natively and delivered at most once per frame and orientation, on the tray's
+     * event thread.
+     */
+    fun setScrollListener(
+        id: String,
+        listener: ((delta: Int, orientation: TrayScrollOrientation) -> Unit)?,
+    ) {
+        lock.withLock {
+            if (listener == null) scrollListeners.remove(id) else scrollListeners[id] = listener
+            linuxTrayManagers[id]?.onScroll = listener
+        }
+    }
+
+    /**
+     * Receive double clicks on the tray icon (null to stop). With [suppressSingleClick] the
+     * left-click callback is held for the double-click interval and dropped when a second
+     * click follows, at the cost of that much latency on every single click.
+     */
+    fun setDoubleClickListener(
+        id: String,
+        listener: (() -> Unit)?,
+        suppressSingleClick: Boolean = false,
+    ) {
+        lock.withLock {
+            if (listener == null) doubleClickListeners.remove(id) else doubleClickListeners[id] = listener
+            val defer = listener != null && suppressSingleClick
+            deferSingleClicks[id] = defer
+            linuxTrayManagers[id]?.let { manager ->
+                manager.onDoubleClick = listener
+                manager.setDeferSingleClick(defer)
+            }
+        }
+    }
+
+    /** Receive middle clicks on the tray icon (null to stop). */
+    fun setMiddleClickListener(
+        id: String,
+        listener: (() -> Unit)?,
+    ) {
+        lock.withLock {
+            if (listener == null) middleClickListeners.remove(id) else middleClickListeners[id] = listener
+            linuxTrayManagers[id]?.onMiddleClick = listener
+        }
+    }
+
+    /**
+     * Be told when a StatusNotifierHost starts or stops showing tray [id] (null to stop).
+     * Without a host, for example on GNOME without the AppIndicator extension, the icon is
+     * invisible and no updates are sent; the app may show a window instead.
+     */
+    fun setHostPresenceListener(
+        id: String,
+        listener: ((present: Boolean) -> Unit)?,
+    ) {
+        lock.withLock {
+            if (listener == null) hostListeners.remove(id) else hostListeners[id] = listener
+            linuxTrayManagers[id]?.onHostPresenceChanged = listener
+        }
+    }
+
+    /** Whether a host currently shows tray [id]; null while unknown or when not running. */
+    fun isHostPresent(id: String): Boolean? = lock.withLock { linuxTrayManagers[id] }?.isHostPresent()
+
+    /**
+     * Post a desktop notification through tray [id]'s own bus connection, with the tray
+     * icon attached as pixels when [withIcon] is set. Returns a token (> 0), or 0 when the
+     * tray is not running.
+     *
+     * [onAction] receives the index in [actions] that was invoked, or -1 for a click on the
+     * notification itself. [onClosed] receives the close reason from the notification spec
+     * (1 expired, 2 dismissed, 3 closed by a call, 4 undefined), or 0 if it was never shown.
+     * Bursts are paced natively, and a pending notification with the same summary is replaced.
+     */
+    fun notify(
+        id: String,
+        summary: String,
+        body: String = "",
+        actions: List<String> = emptyList(),
+        withIcon: Boolean = true,
+        timeoutMs: Int = -1,
+        onAction: ((index: Int) -> Unit)? = null,
+        onClosed: ((reason: Int) -> Unit)? = null,
+    ): Int {
+        val manager = lock.withLock { linuxTrayManagers[id] } ?: return 0
+        val listener =
+            if (onAction != null || onClosed != null) {
+                LinuxTrayManager.NotificationListener(onAction, onClosed)
+            } else {
+                null
+            }
+        return manager.notify(summary, body, actions, withIcon, timeoutMs, listener)
+    }
+
     @Synchronized
     fun dispose(id: String) {
         // Remove references under lock quickly to avoid holding the lock during teardown
@@ -90,6 +260,15 @@ object LinuxTrayInitializer {
         lock.withLock {
             manager = linuxTrayManagers.remove(id)
             menuImpl = trayMenuImpls.remove(id)
+            darkModes.remove(id)
+            iconTemplates.remove(id)
+            statuses.remove(id)
+            attentionIcons.remove(id)
+            scrollListeners.remove(id)
+            doubleClickListeners.remove(id)
+            deferSingleClicks.remove(id)
+            middleClickListeners.remove(id)
+            hostListeners.remove(id)
         }
         // Dispose menu builder immediately (cheap)
         try {
@@ -127,5 +306,34 @@ object LinuxTrayInitializer {
         onMenuOpened: (() -> Unit)? = null,
     ) = update(DEFAULT_ID, iconPath, tooltip, onLeftClick, menuContent, onMenuOpened)
 
+    fun setStatus(status: TrayStatus) = setStatus(DEFAULT_ID, status)
+
+    fun setAttentionIcon(iconPath: String?) = setAttentionIcon(DEFAULT_ID, iconPath)
+
+    fun setScrollListener(listener: ((delta: Int, orientation: TrayScrollOrientation) -> Unit)?) =
+        setScrollListener(DEFAULT_ID, listener)
+
+    fun setDoubleClickListener(
+        listener: (() -> Unit)?,
+        suppressSingleClick: Boolean = false,
+    ) = setDoubleClickListener(DEFAULT_ID, listener, suppressSingleClick)
+
+    fun setMiddleClickListener(listener: (() -> Unit)?) = setMiddleClickListener(DEFAULT_ID, listener)
+
+    fun setHostPresenceListener(listener: ((present: Boolean) -> Unit)?) =
+        setHostPresenceListener(DEFAULT_ID, listener)
+
+    fun isHostPresent(): Boolean? = isHostPresent(DEFAULT_ID)
+
+    fun notify(
+        summary: String,
+        body: String = "",
+        actions: List<String> = emptyList(),
+        withIcon: Boolean = true,
+        timeoutMs: Int = -1,
+        onAction: ((index: Int) -> Unit)? = null,
+        onClosed: ((reason: Int) -> Unit)? = null,
+    ): Int = notify(DEFAULT_ID, summary, body, actions, withIcon, timeoutMs, onAction, onClosed)
+
     fun dispose() = dispose(DEFAULT_ID)
 }
@@ -0,0 +1,80 @@
+package com.kdroid.composetray.tray.impl
+
+import com.kdroid.composetray.utils.errorln
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.flow.collectLatest
+import kotlinx.coroutines.flow.receiveAsFlow
+import kotlinx.coroutines.job
+import kotlinx.coroutines.launch
+import java.util.concurrent.atomic.AtomicLong
+import java.util.concurrent.atomic.AtomicReference
+
+/**
+ * Counters of a [TrayUpdateActor].
+ *
+ * @property applied updates that ran to the end
+ * @property dropped updates replaced before they started, or cancelled while running
+ */
+internal data class TrayUpdateStats(
+    val applied: Long,
+    val dropped: Long,
+)
+
+/**
+ * Runs the updates of one tray one at a time, keeping only the newest.
+ *
+ * A submitted update replaces the pending one and cancels the one in flight, which stops at its
+ * next suspension point: a render retry, or the `ensureActive()` an update makes right before its
+ * native calls. A burst of state changes thus ends in a single native apply of the latest state.
+ */
+internal class TrayUpdateActor(
+    scope: CoroutineScope,
+) {
+    private val pending = AtomicReference<(suspend CoroutineScope.() -> Unit)?>(null)
+    private val wakeups = Channel<Unit>(Channel.CONFLATED)
+
+    @Volatile private var running: Job? = null
+
+    private val applied = AtomicLong()
+    private val dropped = AtomicLong()
+
+    init {
+        scope.launch {
+            wakeups.receiveAsFlow().collectLatest {
+                val update = pending.getAndSet(null) ?: return@collectLatest
+                try {
+                    coroutineScope {
+                        running = coroutineContext.job
+                        update()
+                    }
+                    applied.incrementAndGet()
+                } catch (e: CancellationException) {
+                    dropped.incrementAndGet()
+                    throw e
+                } catch (th: Throwable) {
+                    // Keep the actor alive for the next update
+                    errorln { "[TrayUpdateActor] Update failed: $th" }
+                } finally {
+                    running = null
+                }
+            }
+        }
+    }
+
+    fun submit(update: suspend CoroutineScope.() -> Unit) {
+        if (pending.getAndSet(update) != null) dropped.incrementAndGet()
+        wakeups.trySend(Unit)
+    }
+
+    /** Drops the pending update and cancels the running one; later submissions still run. */
+    fun clear() {
+        if (pending.getAndSet(null) != null) dropped.incrementAndGet()
+        running?.cancel()
+    }
+
+    fun stats(): TrayUpdateStats = TrayUpdateStats(applied.get(), dropped.get())
+}
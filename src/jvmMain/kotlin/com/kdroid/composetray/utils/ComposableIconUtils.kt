@@ -2,20 +2,39 @@ package com.kdroid.composetray.utils
 
 import androidx.compose.runtime.Composable
 import androidx.compose.ui.ImageComposeScene
+import io.github.kdroidfilter.platformtools.OperatingSystem
+import io.github.kdroidfilter.platformtools.getOperatingSystem
 import kotlinx.coroutines.Dispatchers
 import org.jetbrains.skia.Bitmap
-import org.jetbrains.skia.EncodedImageFormat
 import org.jetbrains.skia.FilterMipmap
 import org.jetbrains.skia.FilterMode
 import org.jetbrains.skia.Image
 import org.jetbrains.skia.MipmapMode
-import java.io.File
-import java.util.zip.CRC32
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.ConcurrentLinkedQueue
 
 /**
  * Utility functions for rendering Composable icons to image files for use in system tray.
  */
 object ComposableIconUtils {
+    // Idle scenes kept per render configuration; more concurrent renders just create more
+    private const val MAX_IDLE_SLOTS = 2
+
+    /** A scene and the bitmap its frames are read into, borrowed by one render at a time. */
+    private class RenderSlot(
+        val scene: ImageComposeScene,
+        val bitmap: Bitmap,
+    ) {
+        fun close() {
+            bitmap.close()
+            scene.close()
+        }
+    }
+
+    // Building an ImageComposeScene dominates the cost of a small icon, so scenes are
+    // pooled per size and density and only their content is swapped between renders
+    private val slotPool = ConcurrentHashMap<IconRenderProperties, ConcurrentLinkedQueue<RenderSlot>>()
+
     /**
      * Renders a Composable to a PNG file and returns the path to the file.
      *
@@ -28,17 +47,11 @@ object ComposableIconUtils {
         iconRenderProperties: IconRenderProperties,
         content: @Composable () -> Unit,
     ): String {
-        val tempFile = createTempFile(suffix = ".png")
-        val pngData = renderComposableToPngBytes(iconRenderProperties, content)
-        tempFile.writeBytes(pngData)
-        return tempFile.absolutePath
+        return writePngFile(renderComposableToIcon(iconRenderProperties, content))
     }
 
     /**
      * Renders a Composable to a PNG image and returns the result as a byte array.
-     * This function creates an [ImageComposeScene] based on the provided [IconRenderProperties],
-     * renders the Composable content, and encodes the output into PNG format.
-     * If scaling is required based on the [IconRenderProperties], the rendered content is scaled before encoding.
      *
      * @param iconRenderProperties Properties for rendering the icon
      * @param content The Composable content to render
@@ -48,26 +61,48 @@ object ComposableIconUtils {
     fun renderComposableToPngBytes(
         iconRenderProperties: IconRenderProperties,
         content: @Composable () -> Unit,
-    ): ByteArray {
-        var scene: ImageComposeScene? = null
+    ): ByteArray = renderComposableToIcon(iconRenderProperties, content).pngBytes
+
+    /**
+     * Renders a Composable once into raw pixels. The result carries its own content hash and
+     * encodes itself to PNG or ICO on demand, so callers that hash first and upload later
+     * render a single frame. If [IconRenderProperties.requiresScaling], the frame is scaled
+     * to the target size before the pixels are read.
+     *
+     * @param iconRenderProperties Properties for rendering the icon
+     * @param content The Composable content to render
+     * @return The rendered pixels at the target size
+     * @throws Exception if rendering fails
+     */
+    fun renderComposableToIcon(
+        iconRenderProperties: IconRenderProperties,
+        content: @Composable () -> Unit,
+    ): RenderedIcon {
+        val pool = slotPool.computeIfAbsent(iconRenderProperties) { ConcurrentLinkedQueue() }
+        var slot: RenderSlot? = pool.poll()
         var renderedIcon: Image? = null
-        var scaledBitmap: Bitmap? = null
-        var scaledImage: Image? = null
+        var reusable = false
 
         try {
             // Try to create and render the scene
             try {
-                scene =
-                    ImageComposeScene(
-                        width = iconRenderProperties.sceneWidth,
-                        height = iconRenderProperties.sceneHeight,
-                        density = iconRenderProperties.sceneDensity,
-                        coroutineContext = Dispatchers.Unconfined,
-                    ) {
-                        content()
-                    }
-
-                renderedIcon = scene.render()
+                val current =
+                    slot?.also { it.scene.setContent(content) }
+                        ?: RenderSlot(
+                            ImageComposeScene(
+                                width = iconRenderProperties.sceneWidth,
+                                height = iconRenderProperties.sceneHeight,
+                                density = iconRenderProperties.sceneDensity,
+                                coroutineContext = Dispatchers.Unconfined,
+                            ) {
+                                content()
+                            },
+                            Bitmap().apply {
+                                allocN32Pixels(iconRenderProperties.targetWidth, iconRenderProperties.targetHeight)
+                            },
+                        )
+                slot = current
+                renderedIcon = current.scene.render()
             } catch (e: Exception) {
                 // Log the error but don't modify any system properties
                 val errorMessage = e.message ?: "Unknown error"
@@ -84,41 +119,77 @@ object ComposableIconUtils {
                 throw e
             }
 
-            val iconData =
+            val width = iconRenderProperties.targetWidth
+            val height = iconRenderProperties.targetHeight
+            val bitmap = slot.bitmap
+            val copied =
                 if (iconRenderProperties.requiresScaling) {
-                    scaledBitmap =
-                        Bitmap().apply {
-                            allocN32Pixels(iconRenderProperties.targetWidth, iconRenderProperties.targetHeight)
-                        }
-
                     renderedIcon.scalePixels(
-                        scaledBitmap.peekPixels()!!,
+                        bitmap.peekPixels()!!,
                         FilterMipmap(FilterMode.LINEAR, MipmapMode.LINEAR),
                         true,
                     )
-
-                    scaledImage = Image.makeFromBitmap(scaledBitmap)
-                    scaledImage.encodeToData(EncodedImageFormat.PNG)
-                        ?: throw Exception("Failed to encode scaled image to PNG")
                 } else {
-                    renderedIcon.encodeToData(EncodedImageFormat.PNG)
-                        ?: throw Exception("Failed to encode image to PNG")
+                    renderedIcon.readPixels(bitmap)
                 }
-
-            return iconData.bytes
+            if (!copied) throw Exception("Failed to read rendered pixels")
+            val pixels = bitmap.readPixels() ?: throw Exception("Failed to read rendered pixels")
+            reusable = true
+            return RenderedIcon(width, height, pixels)
         } finally {
-            // Ensure proper cleanup
+            // Ensure proper cleanup; a slot goes back to the pool only after a clean render
             try {
-                scaledImage?.close()
-                scaledBitmap?.close()
                 renderedIcon?.close()
-                scene?.close()
+                slot?.let { finished ->
+                    if (reusable && pool.size < MAX_IDLE_SLOTS) {
+                        // Drop the content so the pool does not keep the caller's state alive
+                        finished.scene.setContent {}
+                        pool.offer(finished)
+                    } else {
+                        finished.close()
+                    }
+                }
             } catch (e: Exception) {
                 debugln { "[ComposableIconUtils] Error during cleanup: ${e.message}" }
             }
         }
     }
 
+    /**
+     * Like [renderComposableToIcon], but logs a failure and returns null instead of throwing.
+     * Meant for composition, where an icon that cannot be rendered must not crash the app.
+     */
+    fun renderComposableToIconOrNull(
+        iconRenderProperties: IconRenderProperties,
+        content: @Composable () -> Unit,
+    ): RenderedIcon? =
+        try {
+            renderComposableToIcon(iconRenderProperties, content)
+        } catch (e: Exception) {
+            errorln { "[ComposableIconUtils] Failed to render icon: ${e.message}" }
+            null
+        }
+
+    /**
+     * Returns a PNG file holding an already rendered icon. Files come from a bounded cache
+     * keyed by content hash, so the same pixels are written to disk at most once.
+     */
+    fun writePngFile(icon: RenderedIcon): String = IconRenderCache.pngFile(icon)
+
+    /** Like [writePngFile], for ICO. */
+    fun writeIcoFile(icon: RenderedIcon): String = IconRenderCache.icoFile(icon)
+
+    /**
+     * Returns the icon path to hand to the tray of the current platform. On Linux this is an
+     * in-memory key that the tray resolves without touching the disk.
+     */
+    internal fun trayIconPath(icon: RenderedIcon): String =
+        if (getOperatingSystem() == OperatingSystem.LINUX) {
+            IconRenderCache.memoryPath(icon)
+        } else {
+            IconRenderCache.pngFile(icon)
+        }
+
     /**
      * Renders a Composable to an ICO file and returns the path to the file.
      *
@@ -131,10 +202,7 @@ object ComposableIconUtils {
         iconRenderProperties: IconRenderProperties,
         content: @Composable (() -> Unit),
     ): String {
-        val tempFile = createTempFile(suffix = ".ico")
-        val icoData = renderComposableToIcoBytes(iconRenderProperties, content)
-        tempFile.writeBytes(icoData)
-        return tempFile.absolutePath
+        return writeIcoFile(renderComposableToIcon(iconRenderProperties, content))
     }
 
     /**
@@ -150,10 +218,13 @@ object ComposableIconUtils {
     fun renderComposableToIcoBytes(
         iconRenderProperties: IconRenderProperties,
         content: @Composable () -> Unit,
-    ): ByteArray {
-        // First render to PNG format (which is supported)
-        val pngBytes = renderComposableToPngBytes(iconRenderProperties, content)
+    ): ByteArray = renderComposableToIcon(iconRenderProperties, content).icoBytes
 
+    internal fun wrapPngInIco(
+        pngBytes: ByteArray,
+        width: Int,
+        height: Int,
+    ): ByteArray {
         // Create a simple ICO format wrapper around the PNG data
         // ICO header (6 bytes) + ICO directory entry (16 bytes) + PNG data
         val icoHeaderSize = 6
@@ -169,8 +240,8 @@ object ComposableIconUtils {
         icoData[5] = 0 // Number of images (high byte)
 
         // ICO directory entry
-        icoData[6] = iconRenderProperties.targetWidth.toByte() // Width (0 means 256)
-        icoData[7] = iconRenderProperties.targetHeight.toByte() // Height (0 means 256)
+        icoData[6] = width.toByte() // Width (0 means 256)
+        icoData[7] = height.toByte() // Height (0 means 256)
         icoData[8] = 0 // Color palette size (0 for no palette)
         icoData[9] = 0 // Reserved, must be 0
         icoData[10] = 1 // Color planes
@@ -198,21 +269,11 @@ object ComposableIconUtils {
         return icoData
     }
 
-    /**
-     * Creates a temporary file that will be deleted when the JVM exits.
-     */
-    private fun createTempFile(
-        prefix: String = "tray_icon_",
-        suffix: String,
-    ): File {
-        val tempFile = File.createTempFile(prefix, suffix)
-        tempFile.deleteOnExit()
-        return tempFile
-    }
-
     /**
      * Calculates a hash value for the rendered composable content.
      * This can be used to detect changes in the composable content without requiring an explicit key.
+     * The hash is taken over raw pixels; prefer [renderComposableToIconOrNull] when the icon is
+     * uploaded afterwards, so the same frame is not rendered twice.
      *
      * @param iconRenderProperties Properties for rendering the icon
      * @param content The Composable content to render
@@ -222,19 +283,7 @@ object ComposableIconUtils {
     fun calculateContentHash(
         iconRenderProperties: IconRenderProperties,
         content: @Composable () -> Unit,
-    ): Long {
-        return try {
-            // Render the composable to PNG bytes
-            val pngBytes = renderComposableToPngBytes(iconRenderProperties, content)
-
-            // Calculate CRC32 hash of the PNG bytes
-            val crc = CRC32()
-            crc.update(pngBytes)
-            crc.value
-        } catch (e: Exception) {
-            errorln { "[ComposableIconUtils] Failed to calculate content hash: ${e.message}" }
-            // Return a time-based hash as fallback
-            System.currentTimeMillis()
-        }
-    }
+    ): Long =
+        // A time-based hash as fallback forces an update attempt
+        renderComposableToIconOrNull(iconRenderProperties, content)?.contentHash ?: System.currentTimeMillis()
 }
@@ -4,6 +4,8 @@ import androidx.compose.runtime.Composable
 import androidx.compose.runtime.DisposableEffect
 import androidx.compose.runtime.mutableStateOf
 import androidx.compose.runtime.remember
+import com.kdroid.composetray.lib.linux.LinuxNativeBridge
+import com.kdroid.composetray.lib.linux.LinuxThemeDetector
 import com.kdroid.composetray.lib.mac.MacOSMenuBarThemeDetector
 import io.github.kdroidfilter.nucleus.darkmodedetector.isSystemInDarkMode
 import io.github.kdroidfilter.platformtools.LinuxDesktopEnvironment
@@ -19,8 +21,35 @@ fun isMenuBarInDarkMode(): Boolean {
     return when (getOperatingSystem()) {
         MACOS -> isMacOsMenuBarInDarkMode()
         WINDOWS -> isSystemInDarkMode()
-        LINUX ->
-            when (detectLinuxDesktopEnvironment()) {
+        LINUX -> isLinuxMenuBarInDarkMode()
+        else -> true
+    }
+}
+
+/**
+ * Follows the settings portal's color-scheme when it states a preference. GNOME Shell keeps
+ * its top bar dark in the light scheme, so only "prefer dark" is taken from the portal there.
+ * Without a preference the per-desktop defaults apply.
+ */
+@Composable
+internal fun isLinuxMenuBarInDarkMode(): Boolean {
+    val environment = remember { detectLinuxDesktopEnvironment() }
+    val colorScheme = remember { mutableStateOf(LinuxThemeDetector.colorScheme) }
+    DisposableEffect(Unit) {
+        val listener =
+            Consumer<Int> { newValue ->
+                colorScheme.value = newValue
+            }
+        LinuxThemeDetector.registerListener(listener)
+        onDispose {
+            LinuxThemeDetector.removeListener(listener)
+        }
+    }
+    return when (colorScheme.value) {
+        LinuxNativeBridge.COLOR_SCHEME_DARK -> true
+        LinuxNativeBridge.COLOR_SCHEME_LIGHT -> environment == LinuxDesktopEnvironment.GNOME
+        else ->
+            when (environment) {
                 LinuxDesktopEnvironment.GNOME -> true
                 LinuxDesktopEnvironment.KDE -> isSystemInDarkMode()
                 LinuxDesktopEnvironment.XFCE -> true
@@ -29,7 +58,6 @@ fun isMenuBarInDarkMode(): Boolean {
                 LinuxDesktopEnvironment.UNKNOWN -> true
                 null -> isSystemInDarkMode()
             }
-        else -> true
     }
 }
 
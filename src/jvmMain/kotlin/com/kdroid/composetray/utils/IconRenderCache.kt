@@ -0,0 +1,92 @@
+package com.kdroid.composetray.utils
+
+import java.io.File
+import java.nio.file.Files
+
+/**
+ * Bounded in-memory cache of rendered icons, keyed by content hash and size.
+ *
+ * Linux takes icon bytes straight from here through [memoryPath] keys, so rendering an icon
+ * touches no file. Platforms whose native side loads icons from disk get one file per
+ * distinct icon from [pngFile]/[icoFile], written on first use and deleted on eviction;
+ * re-rendering an unchanged icon reuses it instead of creating a new temp file.
+ */
+internal object IconRenderCache {
+    private const val MAX_ENTRIES = 64
+    private const val MEMORY_PREFIX = "memory:tray-icon/"
+
+    private class Entry(
+        val icon: RenderedIcon,
+    ) {
+        var pngFile: File? = null
+        var icoFile: File? = null
+    }
+
+    // Access-ordered, so the least recently used icon is evicted first
+    private val entries =
+        object : LinkedHashMap<String, Entry>(16, 0.75f, true) {
+            override fun removeEldestEntry(eldest: MutableMap.MutableEntry<String, Entry>): Boolean {
+                if (size <= MAX_ENTRIES) return false
+                eldest.value.pngFile?.delete()
+                eldest.value.icoFile?.delete()
+                return true
+            }
+        }
+
+    // One directory for every icon file, removed as a whole at exit: no per-file
+    // deleteOnExit registrations piling up in a long-running process
+    private val directory: File by lazy {
+        Files.createTempDirectory("tray_icons_").toFile().also { dir ->
+            Runtime.getRuntime().addShutdownHook(Thread { dir.deleteRecursively() })
+        }
+    }
+
+    private fun keyOf(icon: RenderedIcon): String =
+        "%016x-%dx%d".format(icon.contentHash, icon.width, icon.height)
+
+    private fun entryFor(icon: RenderedIcon): Pair<String, Entry> {
+        val key = keyOf(icon)
+        return key to entries.getOrPut(key) { Entry(icon) }
+    }
+
+    /** A path-like key that [readBytes] resolves from memory; nothing is written to disk. */
+    @Synchronized
+    fun memoryPath(icon: RenderedIcon): String = MEMORY_PREFIX + entryFor(icon).first + ".png"
+
+    /** A PNG file holding [icon], shared by every render of the same pixels. */
+    @Synchronized
+    fun pngFile(icon: RenderedIcon): String {
+        val (key, entry) = entryFor(icon)
+        val file = entry.pngFile ?: File(directory, "$key.png").also { it.writeBytes(entry.icon.pngBytes) }
+        entry.pngFile = file
+        return file.absolutePath
+    }
+
+    /** An ICO file holding [icon], shared by every render of the same pixels. */
+    @Synchronized
+    fun icoFile(icon: RenderedIcon): String {
+        val (key, entry) = entryFor(icon)
+        val file = entry.icoFile ?: File(directory, "$key.ico").also { it.writeBytes(entry.icon.icoBytes) }
+        entry.icoFile = file
+        return file.absolutePath
+    }
+
+    /** The rendered icon behind a [memoryPath] key, or null for regular files and evicted keys. */
+    fun iconFor(path: String): RenderedIcon? {
+        if (!path.startsWith(MEMORY_PREFIX)) return null
+        val key = path.removePrefix(MEMORY_PREFIX).removeSuffix(".png")
+        return synchronized(this) { entries[key] }?.icon
+    }
+
+    /**
+     * PNG bytes for a [memoryPath] key, or the contents of a regular file.
+     * Null if the key was evicted or the file does not exist.
+     */
+    fun readBytes(path: String): ByteArray? {
+        if (path.startsWith(MEMORY_PREFIX)) {
+            val key = path.removePrefix(MEMORY_PREFIX).removeSuffix(".png")
+            return synchronized(this) { entries[key] }?.icon?.pngBytes
+        }
+        return File(path).takeIf { it.isFile }?.readBytes()
+    }
+}
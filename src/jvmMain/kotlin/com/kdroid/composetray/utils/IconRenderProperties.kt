@@ -45,7 +45,8 @@ data class IconRenderProperties(
                 when (getOperatingSystem()) {
                     OperatingSystem.WINDOWS -> 32 to 32
                     OperatingSystem.MACOS -> 44 to 44
-                    OperatingSystem.LINUX -> 24 to 24
+                    // The largest pixmap size; smaller ones are sampled from it, see RenderedIcon.rgbaLadder
+                    OperatingSystem.LINUX -> 128 to 128
                     else -> sceneWidth to sceneHeight
                 }
 
@@ -0,0 +1,68 @@
+package com.kdroid.composetray.utils
+
+import org.jetbrains.skia.Bitmap
+import org.jetbrains.skia.ColorAlphaType
+import org.jetbrains.skia.ColorType
+import org.jetbrains.skia.EncodedImageFormat
+import org.jetbrains.skia.FilterMipmap
+import org.jetbrains.skia.FilterMode
+import org.jetbrains.skia.Image
+import org.jetbrains.skia.ImageInfo
+import org.jetbrains.skia.MipmapMode
+import java.util.zip.CRC32
+
+/**
+ * A Composable icon rendered once, kept as raw N32 premultiplied pixels.
+ *
+ * The hash is taken from the pixels themselves, and every encoding is derived from the
+ * same pixels on first use, so checking whether an icon changed never costs a second render.
+ */
+class RenderedIcon internal constructor(
+    val width: Int,
+    val height: Int,
+    private val pixels: ByteArray,
+) {
+    /** CRC32 of the raw pixels: identical frames hash identically, whatever the encoder does. */
+    val contentHash: Long = CRC32().apply { update(pixels) }.value
+
+    /** PNG encoding of the pixels. */
+    val pngBytes: ByteArray by lazy {
+        val info = ImageInfo.makeN32(width, height, ColorAlphaType.PREMUL)
+        Image.makeRaster(info, pixels, width * 4).use { image ->
+            image.encodeToData(EncodedImageFormat.PNG)?.bytes
+                ?: throw Exception("Failed to encode image to PNG")
+        }
+    }
+
+    /**
+     * The icon resampled to every size in [sizes], as straight-alpha RGBA rows laid out back
+     * to back in the order given. Every size is sampled, with mipmaps, from these same pixels,
+     * so rendering once at the largest size keeps every size sharp.
+     */
+    internal fun rgbaLadder(sizes: IntArray): ByteArray {
+        val out = ByteArray(sizes.sumOf { it * it * 4 })
+        var offset = 0
+        val info = ImageInfo.makeN32(width, height, ColorAlphaType.PREMUL)
+        Image.makeRaster(info, pixels, width * 4).use { image ->
+            for (size in sizes) {
+                Bitmap().use { bitmap ->
+                    bitmap.allocPixels(ImageInfo(size, size, ColorType.RGBA_8888, ColorAlphaType.UNPREMUL))
+                    val scaled =
+                        image.scalePixels(
+                            bitmap.peekPixels()!!,
+                            FilterMipmap(FilterMode.LINEAR, MipmapMode.LINEAR),
+                            true,
+                        )
+                    if (!scaled) throw Exception("Failed to scale icon to ${size}px")
+                    val rgba = bitmap.readPixels() ?: throw Exception("Failed to read ${size}px icon")
+                    rgba.copyInto(out, offset)
+                    offset += rgba.size
+                }
+            }
+        }
+        return out
+    }
+
+    /** Single-image ICO wrapping [pngBytes]. */
+    val icoBytes: ByteArray by lazy { ComposableIconUtils.wrapPngInIco(pngBytes, width, height) }
+}
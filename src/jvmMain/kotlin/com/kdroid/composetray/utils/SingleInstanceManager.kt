@@ -1,26 +1,51 @@
 package com.kdroid.composetray.utils
 
+import java.io.DataInputStream
+import java.io.DataOutputStream
+import java.io.EOFException
 import java.io.File
+import java.io.IOException
 import java.io.RandomAccessFile
+import java.net.StandardProtocolFamily
+import java.net.UnixDomainSocketAddress
+import java.nio.channels.Channels
+import java.nio.channels.ClosedChannelException
 import java.nio.channels.FileChannel
 import java.nio.channels.FileLock
 import java.nio.channels.OverlappingFileLockException
+import java.nio.channels.ServerSocketChannel
+import java.nio.channels.SocketChannel
 import java.nio.file.FileSystems
 import java.nio.file.Files
 import java.nio.file.Path
 import java.nio.file.Paths
 import java.nio.file.StandardCopyOption
 import java.nio.file.StandardWatchEventKinds
+import java.util.concurrent.Executors
+import java.util.concurrent.ScheduledExecutorService
+import java.util.concurrent.TimeUnit
 
 /**
  * Singleton object to manage the single instance of an application.
  *
  * This object ensures that only one instance of the application can run at a time,
  * and provides a mechanism to notify the running instance when another instance attempts to start.
+ *
+ * Restore requests travel over a Unix domain socket next to the lock file, carrying the
+ * arguments and working directory of the new instance. When the socket cannot be used, or
+ * when the new instance writes a restore file, they go through the file watcher instead.
  */
 object SingleInstanceManager {
     private const val TAG = "SingleInstanceChecker"
 
+    // Restore message: MAGIC, VERSION, working directory, argument count, arguments;
+    // integers big-endian, strings as a byte length followed by UTF-8
+    private const val MAGIC = 0x54524159 // "TRAY"
+    private const val VERSION = 1
+    private const val MAX_ARGS = 4096
+    private const val MAX_STRING_BYTES = 1 shl 20
+    private const val READ_TIMEOUT_MS = 2_000L
+
     /**
      * Don't inline to [Configuration] initializer to prevent multiple calls with the different stack depth.
      */
@@ -38,11 +63,24 @@ object SingleInstanceManager {
     ) {
         val lockFileName: String = "$lockIdentifier.lock"
         val restoreRequestFileName: String = "$lockIdentifier.restore_request"
+        val socketFileName: String = "$lockIdentifier.sock"
 
         val lockFilePath: Path = lockFilesDir.resolve(lockFileName)
         val restoreRequestFilePath: Path = lockFilesDir.resolve(restoreRequestFileName)
+        val socketFilePath: Path = lockFilesDir.resolve(socketFileName)
     }
 
+    /**
+     * A restore request received over the socket.
+     *
+     * @property args the arguments the new instance passed to [isSingleInstance]
+     * @property workingDirectory the working directory of the new instance
+     */
+    data class RestoreRequest(
+        val args: List<String>,
+        val workingDirectory: String,
+    )
+
     var configuration: Configuration = Configuration()
         set(value) {
             check(fileChannel == null) { "Configuration can be changed only before first call to isSingleInstance()!" }
@@ -51,15 +89,30 @@ object SingleInstanceManager {
 
     private var fileChannel: FileChannel? = null
     private var fileLock: FileLock? = null
+    private var serverChannel: ServerSocketChannel? = null
+    private val restoreDispatchLock = Any()
+
+    private val readTimeouts: ScheduledExecutorService by lazy {
+        Executors.newSingleThreadScheduledExecutor { task ->
+            Thread(task, "single-instance-timeout").apply { isDaemon = true }
+        }
+    }
     private var isWatching = false
 
     /**
      * Checks if the current process is the single running instance.
      *
+     * @param onRestoreFileCreated Lets a new instance write data for the running one into the restore file;
+     *   such requests go through the file watcher.
+     * @param args Sent to the running instance by a new one, e.g. the arguments of `main`.
+     * @param onRestoreArgs Invoked with the arguments and working directory of a new instance, before
+     *   [onRestoreRequest]; only for requests received over the socket.
      * @param onRestoreRequest A function to be executed if a restore request is received from another instance.
      */
     fun isSingleInstance(
         onRestoreFileCreated: (Path.() -> Unit)? = null,
+        args: List<String> = emptyList(),
+        onRestoreArgs: ((RestoreRequest) -> Unit)? = null,
         onRestoreRequest: Path.() -> Unit,
     ): Boolean {
         // If the lock is already acquired by this process, we are the first instance
@@ -77,10 +130,12 @@ object SingleInstanceManager {
                 // Ensure that watching is started only once
                 if (!isWatching) {
                     isWatching = true
+                    listenForRestoreRequests(onRestoreArgs, onRestoreRequest)
                     watchForRestoreRequests(onRestoreRequest)
                 }
                 Runtime.getRuntime().addShutdownHook(
                     Thread {
+                        closeSocket()
                         releaseLock()
                         lockFile.delete()
                         deleteRestoreRequestFile()
@@ -90,7 +145,9 @@ object SingleInstanceManager {
                 true
             } else {
                 // Another instance is already running
-                sendRestoreRequest(onRestoreFileCreated)
+                if (onRestoreFileCreated != null || !sendRestoreMessage(args)) {
+                    sendRestoreRequest(onRestoreFileCreated)
+                }
                 debugLog { "Restore request sent to the existing instance" }
                 false
             }
@@ -110,8 +167,121 @@ object SingleInstanceManager {
         return lockFile
     }
 
+    /**
+     * Serves restore requests on [Configuration.socketFilePath]. We hold the lock, so a socket
+     * file already there was left by a crashed instance and is replaced.
+     */
+    private fun listenForRestoreRequests(
+        onRestoreArgs: ((RestoreRequest) -> Unit)?,
+        onRestoreRequest: Path.() -> Unit,
+    ) {
+        val server =
+            try {
+                val socketPath = configuration.socketFilePath
+                Files.deleteIfExists(socketPath)
+                ServerSocketChannel.open(StandardProtocolFamily.UNIX).apply {
+                    bind(UnixDomainSocketAddress.of(socketPath))
+                }
+            } catch (e: Exception) {
+                // e.g. a path beyond the platform limit: the file watcher still serves requests
+                debugLog { "Restore socket unavailable, using the file watcher only: $e" }
+                return
+            }
+        serverChannel = server
+        Thread({
+            debugLog { "Listening for restore requests on ${configuration.socketFilePath}" }
+            while (server.isOpen) {
+                try {
+                    val client = server.accept()
+                    // Read off the accept thread: a client that stalls mid-frame must not block the next one
+                    Thread(
+                        { serveRestoreConnection(client, onRestoreArgs, onRestoreRequest) },
+                        "single-instance-client",
+                    ).apply { isDaemon = true }.start()
+                } catch (_: ClosedChannelException) {
+                    break
+                } catch (e: Exception) {
+                    errorLog { "Error while accepting restore request: $e" }
+                }
+            }
+        }, "single-instance-socket").apply { isDaemon = true }.start()
+    }
+
+    private fun serveRestoreConnection(
+        client: SocketChannel,
+        onRestoreArgs: ((RestoreRequest) -> Unit)?,
+        onRestoreRequest: Path.() -> Unit,
+    ) {
+        // Closing the channel aborts a read still blocked past the deadline
+        val deadline =
+            readTimeouts.schedule(Runnable { runCatching { client.close() } }, READ_TIMEOUT_MS, TimeUnit.MILLISECONDS)
+        val request =
+            try {
+                client.use(::readRestoreMessage)
+            } catch (e: Exception) {
+                errorLog { "Error while reading restore request: $e" }
+                return
+            } finally {
+                deadline.cancel(false)
+            }
+        debugLog { "Restore request received: $request" }
+        // One request at a time, as callers of the file watcher always had it
+        synchronized(restoreDispatchLock) {
+            try {
+                onRestoreArgs?.invoke(request)
+                configuration.restoreRequestFilePath.onRestoreRequest()
+            } catch (e: Exception) {
+                errorLog { "Error while handling restore request: $e" }
+            }
+        }
+    }
+
+    private fun readRestoreMessage(channel: SocketChannel): RestoreRequest {
+        val input = DataInputStream(Channels.newInputStream(channel).buffered())
+
+        fun readString(): String {
+            val length = input.readInt()
+            if (length !in 0..MAX_STRING_BYTES) throw IOException("Invalid string length $length")
+            val bytes = input.readNBytes(length)
+            if (bytes.size < length) throw EOFException()
+            return String(bytes, Charsets.UTF_8)
+        }
+
+        if (input.readInt() != MAGIC || input.readInt() != VERSION) throw IOException("Unknown restore message")
+        val workingDirectory = readString()
+        val count = input.readInt()
+        if (count !in 0..MAX_ARGS) throw IOException("Invalid argument count $count")
+        return RestoreRequest(List(count) { readString() }, workingDirectory)
+    }
+
+    /** Returns false if no instance listens on the socket, so the caller falls back to the restore file. */
+    private fun sendRestoreMessage(args: List<String>): Boolean =
+        try {
+            SocketChannel.open(UnixDomainSocketAddress.of(configuration.socketFilePath)).use { channel ->
+                val output = DataOutputStream(Channels.newOutputStream(channel).buffered())
+
+                fun writeString(value: String) {
+                    val bytes = value.toByteArray(Charsets.UTF_8)
+                    output.writeInt(bytes.size)
+                    output.write(bytes)
+                }
+
+                output.writeInt(MAGIC)
+                output.writeInt(VERSION)
+                writeString(System.getProperty("user.dir").orEmpty())
+                output.writeInt(args.size)
+                args.forEach(::writeString)
+                output.flush()
+            }
+            debugLog { "Restore request sent over ${configuration.socketFilePath}" }
+            true
+        } catch (e: Exception) {
+            debugLog { "Restore socket unreachable, falling back to the restore file: $e" }
+            false
+        }
+
     private fun watchForRestoreRequests(onRestoreRequest: Path.() -> Unit) {
-        Thread {
+        Thread({
             try {
                 val watchService = FileSystems.getDefault().newWatchService()
                 configuration.lockFilesDir.register(watchService, StandardWatchEventKinds.ENTRY_CREATE)
@@ -139,7 +309,7 @@ object SingleInstanceManager {
             } catch (e: Exception) {
                 errorLog { "Error in watchForRestoreRequests: $e" }
             }
-        }.start()
+        }, "single-instance-watcher").apply { isDaemon = true }.start()
     }
 
     private fun sendRestoreRequest(onRestoreFileCreated: (Path.() -> Unit)?) {
@@ -168,6 +338,15 @@ object SingleInstanceManager {
         }
     }
 
+    private fun closeSocket() {
+        try {
+            serverChannel?.close()
+            Files.deleteIfExists(configuration.socketFilePath)
+        } catch (e: Exception) {
+            errorLog { "Error while closing the restore socket: $e" }
+        }
+    }
+
     private fun releaseLock() {
         try {
             fileLock?.release()
@@ -13,8 +13,16 @@ import java.awt.GraphicsEnvironment
 import java.awt.Rectangle
 import java.awt.Toolkit
 import java.io.File
+import java.nio.file.AtomicMoveNotSupportedException
+import java.nio.file.Files
+import java.nio.file.StandardCopyOption
 import java.util.Collections
 import java.util.Properties
+import java.util.concurrent.CopyOnWriteArrayList
+import java.util.concurrent.Executors
+import java.util.concurrent.ScheduledExecutorService
+import java.util.concurrent.TimeUnit
+import java.util.concurrent.atomic.AtomicBoolean
 import java.util.concurrent.atomic.AtomicReference
 import kotlin.math.roundToInt
 
@@ -30,6 +38,21 @@ internal object TrayClickTracker {
     private val lastClickPosition = AtomicReference<TrayClickPosition?>(null)
     private val perInstancePositions: MutableMap<String, TrayClickPosition> =
         Collections.synchronizedMap(mutableMapOf())
+    private val listeners = CopyOnWriteArrayList<() -> Unit>()
+
+    /** Invoked after every position change, so consumers can cache derived geometry. */
+    fun addListener(listener: () -> Unit) {
+        listeners.add(listener)
+    }
+
+    fun removeListener(listener: () -> Unit) {
+        listeners.remove(listener)
+    }
+
+    private fun publish(pos: TrayClickPosition) {
+        lastClickPosition.set(pos)
+        listeners.forEach { runCatching { it() } }
+    }
 
     fun updateClickPosition(
         x: Int,
@@ -38,7 +61,7 @@ internal object TrayClickTracker {
         val bounds = getScreenBoundsAt(x, y)
         val position = convertPositionToCorner(x - bounds.x, y - bounds.y, bounds.width, bounds.height)
         val pos = TrayClickPosition(x, y, position)
-        lastClickPosition.set(pos)
+        publish(pos)
         runCatching { saveTrayClickPosition(x, y, position) }
     }
 
@@ -51,7 +74,7 @@ internal object TrayClickTracker {
         val position = convertPositionToCorner(x - bounds.x, y - bounds.y, bounds.width, bounds.height)
         val pos = TrayClickPosition(x, y, position)
         perInstancePositions[instanceId] = pos
-        lastClickPosition.set(pos)
+        publish(pos)
         runCatching { saveTrayClickPosition(x, y, position) }
     }
 
@@ -61,7 +84,7 @@ internal object TrayClickTracker {
         position: TrayPosition,
     ) {
         val pos = TrayClickPosition(x, y, position)
-        lastClickPosition.set(pos)
+        publish(pos)
         runCatching { saveTrayClickPosition(x, y, position) }
     }
 
@@ -73,7 +96,7 @@ internal object TrayClickTracker {
     ) {
         val pos = TrayClickPosition(x, y, position)
         perInstancePositions[instanceId] = pos
-        lastClickPosition.set(pos)
+        publish(pos)
         runCatching { saveTrayClickPosition(x, y, position) }
     }
 
@@ -182,61 +205,107 @@ private fun loadPropertiesFrom(file: File): Properties? {
     }.getOrNull()
 }
 
-private fun storePropertiesTo(
-    file: File,
-    props: Properties,
-) {
-    file.parentFile?.let { runCatching { if (!it.exists()) it.mkdirs() } }
-    runCatching { file.outputStream().use { props.store(it, null) } }
-}
+/**
+ * The persisted tray position, held in memory.
+ *
+ * The properties files are read once, on first use. Saves only replace the in-memory state and
+ * schedule a write on a background thread; saves landing before it runs are coalesced into it.
+ * The file is written to a temporary sibling and renamed over the old one, so a reader never
+ * sees it half written. Click handling and hit tests therefore never touch the disk.
+ */
+private object TrayPositionStore {
+    private const val WRITE_DELAY_MS = 500L
+
+    private class State(
+        val position: TrayPosition?,
+        val click: TrayClickPosition?,
+    )
+
+    private val state: AtomicReference<State> by lazy { AtomicReference(load()) }
+    private val writeScheduled = AtomicBoolean(false)
+
+    private val writer: ScheduledExecutorService by lazy {
+        Executors.newSingleThreadScheduledExecutor { task ->
+            Thread(task, "tray-position-writer").apply { isDaemon = true }
+        }.also { Runtime.getRuntime().addShutdownHook(Thread { flush() }) }
+    }
+
+    // Resolved once: finding a writable directory may create it
+    private val file: File by lazy { trayPropertiesFile() }
+
+    private fun load(): State {
+        val props =
+            loadPropertiesFrom(trayPropertiesFile())
+                ?: macCachePropertiesFile()?.let { loadPropertiesFrom(it) }
+                ?: loadPropertiesFrom(oldTmpPropertiesFile())
+                ?: loadPropertiesFrom(legacyPropertiesFile())
+                ?: return State(null, null)
+        val position = props.getProperty(POSITION_KEY)?.let { runCatching { TrayPosition.valueOf(it) }.getOrNull() }
+        val x = props.getProperty(X_KEY)?.toIntOrNull()
+        val y = props.getProperty(Y_KEY)?.toIntOrNull()
+        val click = if (position != null && x != null && y != null) TrayClickPosition(x, y, position) else null
+        return State(position, click)
+    }
+
+    val position: TrayPosition? get() = state.get().position
+
+    val click: TrayClickPosition? get() = state.get().click
 
-internal fun saveTrayPosition(position: TrayPosition) {
-    val preferredFile = trayPropertiesFile()
-    val properties =
-        loadPropertiesFrom(preferredFile)
-            ?: macCachePropertiesFile()?.let { loadPropertiesFrom(it) }
-            ?: loadPropertiesFrom(oldTmpPropertiesFile())
-            ?: loadPropertiesFrom(legacyPropertiesFile())
-            ?: Properties()
-    properties.setProperty(POSITION_KEY, position.name)
-    storePropertiesTo(preferredFile, properties)
+    fun savePosition(position: TrayPosition) {
+        state.updateAndGet { State(position, it.click) }
+        scheduleWrite()
+    }
+
+    fun saveClick(click: TrayClickPosition) {
+        state.set(State(click.position, click))
+        scheduleWrite()
+    }
+
+    // Same monitor as flush(): a write already under way finishes before the files are deleted
+    @Synchronized
+    fun clear() {
+        state.set(State(null, null))
+        writeScheduled.set(false)
+    }
+
+    private fun scheduleWrite() {
+        if (writeScheduled.compareAndSet(false, true)) {
+            runCatching { writer.schedule(::flush, WRITE_DELAY_MS, TimeUnit.MILLISECONDS) }
+        }
+    }
+
+    @Synchronized
+    private fun flush() {
+        if (!writeScheduled.getAndSet(false)) return
+        val current = state.get()
+        val props = Properties()
+        current.position?.let { props.setProperty(POSITION_KEY, it.name) }
+        current.click?.let {
+            props.setProperty(X_KEY, it.x.toString())
+            props.setProperty(Y_KEY, it.y.toString())
+        }
+        runCatching {
+            file.parentFile?.let { if (!it.exists()) it.mkdirs() }
+            val tmp = File(file.parentFile, file.name + ".tmp")
+            tmp.outputStream().use { props.store(it, null) }
+            try {
+                Files.move(tmp.toPath(), file.toPath(), StandardCopyOption.ATOMIC_MOVE)
+            } catch (_: AtomicMoveNotSupportedException) {
+                Files.move(tmp.toPath(), file.toPath(), StandardCopyOption.REPLACE_EXISTING)
+            }
+        }.onFailure { e -> debugln { "[TrayPosition] Failed to persist tray position: ${e.message}" } }
+    }
 }
 
+internal fun saveTrayPosition(position: TrayPosition) = TrayPositionStore.savePosition(position)
+
 internal fun saveTrayClickPosition(
     x: Int,
     y: Int,
     position: TrayPosition,
-) {
-    val preferredFile = trayPropertiesFile()
-    val properties =
-        loadPropertiesFrom(preferredFile)
-            ?: macCachePropertiesFile()?.let { loadPropertiesFrom(it) }
-            ?: loadPropertiesFrom(oldTmpPropertiesFile())
-            ?: loadPropertiesFrom(legacyPropertiesFile())
-            ?: Properties()
-    properties.setProperty(POSITION_KEY, position.name)
-    properties.setProperty(X_KEY, x.toString())
-    properties.setProperty(Y_KEY, y.toString())
-    storePropertiesTo(preferredFile, properties)
-}
-
-internal fun loadTrayClickPosition(): TrayClickPosition? {
-    val props =
-        loadPropertiesFrom(trayPropertiesFile())
-            ?: macCachePropertiesFile()?.let { loadPropertiesFrom(it) }
-            ?: loadPropertiesFrom(oldTmpPropertiesFile())
-            ?: loadPropertiesFrom(legacyPropertiesFile()) ?: return null
+) = TrayPositionStore.saveClick(TrayClickPosition(x, y, position))
 
-    val positionStr = props.getProperty(POSITION_KEY) ?: return null
-    val x = props.getProperty(X_KEY)?.toIntOrNull() ?: return null
-    val y = props.getProperty(Y_KEY)?.toIntOrNull() ?: return null
-
-    return try {
-        TrayClickPosition(x, y, TrayPosition.valueOf(positionStr))
-    } catch (_: IllegalArgumentException) {
-        null
-    }
-}
+internal fun loadTrayClickPosition(): TrayClickPosition? = TrayPositionStore.click
 
 internal fun getWindowsTrayPosition(nativeResult: String?): TrayPosition =
     when (nativeResult) {
@@ -255,17 +324,7 @@ fun getTrayPosition(): TrayPosition {
         OperatingSystem.MACOS -> getMacTrayPosition(MacNativeBridge.nativeGetStatusItemRegion())
         OperatingSystem.LINUX -> {
             TrayClickTracker.getLastClickPosition()?.position
-                ?: loadTrayClickPosition()?.position
-                ?: run {
-                    val props =
-                        loadPropertiesFrom(trayPropertiesFile())
-                            ?: macCachePropertiesFile()?.let { loadPropertiesFrom(it) }
-                            ?: loadPropertiesFrom(oldTmpPropertiesFile())
-                            ?: loadPropertiesFrom(legacyPropertiesFile())
-                    props?.getProperty(POSITION_KEY)?.let {
-                        runCatching { TrayPosition.valueOf(it) }.getOrNull()
-                    }
-                }
+                ?: TrayPositionStore.position
                 ?: when (detectLinuxDesktopEnvironment()) {
                     LinuxDesktopEnvironment.KDE -> TrayPosition.BOTTOM_RIGHT
                     LinuxDesktopEnvironment.CINNAMON -> TrayPosition.BOTTOM_RIGHT
@@ -543,6 +602,7 @@ internal fun getStatusItemXYForMac(): Pair<Int, Int> {
 }
 
 fun debugDeleteTrayPropertiesFiles() {
+    TrayPositionStore.clear()
     val files =
         setOfNotNull(
             trayPropertiesFile(),
@@ -607,13 +667,9 @@ internal fun isPointWithinMacStatusItem(
     return px in left..right && py in top..bottom
 }
 
-internal fun isPointWithinLinuxStatusItem(
-    px: Int,
-    py: Int,
-): Boolean {
-    if (getOperatingSystem() != OperatingSystem.LINUX) return false
-    val click = TrayClickTracker.getLastClickPosition() ?: loadTrayClickPosition() ?: return false
-    val (ix, iy) = click.x to click.y
+// Half the hit box around the tray click: half the DE's icon size plus a small fudge,
+// scaled by DPI. Neither the desktop environment nor the DPI changes during a session.
+private val linuxStatusItemHalfExtent: Int by lazy {
     val baseIconSizeAt1x =
         when (detectLinuxDesktopEnvironment()) {
             LinuxDesktopEnvironment.KDE -> 22
@@ -627,11 +683,15 @@ internal fun isPointWithinLinuxStatusItem(
     val scale = (dpi / 96.0).coerceAtLeast(0.5)
     val half = (baseIconSizeAt1x * 0.5 * scale).toInt().coerceAtLeast(8)
     val fudge = (4 * scale).toInt().coerceAtLeast(2)
-    val left = ix - half - fudge
-    val right = ix + half + fudge
-    val top = iy - half - fudge
-    val bottom = iy + half + fudge
-    return px in left..right && py in top..bottom
+    half + fudge
+}
+
+/** Screen rectangle of the Linux tray icon, derived from the last tray click; null if unknown. */
+internal fun linuxStatusItemBounds(): Rectangle? {
+    if (getOperatingSystem() != OperatingSystem.LINUX) return null
+    val click = TrayClickTracker.getLastClickPosition() ?: loadTrayClickPosition() ?: return null
+    val extent = linuxStatusItemHalfExtent
+    return Rectangle(click.x - extent, click.y - extent, 2 * extent + 1, 2 * extent + 1)
 }
 
 // TrayPosition.kt
@@ -6,8 +6,7 @@
  *
  * Follows the same patterns as macOS MacTrayBridge.m:
  * - JavaVM cache with JNI_OnLoad
- * - GlobalRef-based callback storage
- * - Runnable trampolines for callbacks
+ * - One GlobalRef event dispatcher per tray, invoked via a cached method ID
  * - Handle-based state (sni_tray* as jlong)
  */
 
@@ -16,6 +15,12 @@
 #include <string.h>
 #include <stdint.h>
 #include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 
 #include "sni.h"
 
@@ -42,85 +47,96 @@ static JNIEnv *getJNIEnv(void) {
 }
 
 /* ========================================================================== */
-/*  Callback storage (GlobalRef linked list, same as MacTrayBridge.m)         */
+/*  Per-tray event dispatch                                                   */
 /* ========================================================================== */
 
-typedef struct CallbackEntry {
-    uintptr_t key;
-    jobject globalRef;
-    struct CallbackEntry *next;
-} CallbackEntry;
+/* Event types delivered to LinuxNativeBridge.TrayEventDispatcher.onTrayEvent().
+ * Must stay in sync with the EVENT_* constants in LinuxNativeBridge.kt. */
+#define EVT_CLICK        1
+#define EVT_RCLICK       2
+#define EVT_MENU_ITEM    3
+#define EVT_MENU_OPENED  4
+#define EVT_COLOR_SCHEME 5   /* x = SNI_COLOR_SCHEME_* */
+#define EVT_SCROLL       6   /* x = summed delta, y = SNI_SCROLL_* */
+#define EVT_DOUBLE_CLICK 7
+#define EVT_MIDDLE_CLICK 8
+#define EVT_NOTIFICATION 9   /* itemId = token, x = action, y = close reason */
+#define EVT_HOST         10  /* x = 1 when a StatusNotifierHost is present */
+
+/* One context per tray. It is the userdata of every sni_* callback, so the
+ * hot path goes straight from the D-Bus handler to a single cached upcall
+ * without any lookup. The registry below is only walked on (un)registration. */
+typedef struct TrayContext {
+    sni_tray *tray;
+    jobject   dispatcher;   /* GlobalRef to TrayEventDispatcher, or NULL */
+    struct TrayContext *next;
+} TrayContext;
+
+static TrayContext    *g_trayContexts = NULL;
+static pthread_mutex_t g_trayContextsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Cached onTrayEvent(IIIIJ)V method ID.
+ * Resolved on the interface class (not GetObjectClass()) so GraalVM
+ * native-image only needs the interface registered for JNI access. */
+static jmethodID g_onTrayEventMethod = NULL;
+
+static int ensureDispatcherCached(JNIEnv *env) {
+    if (g_onTrayEventMethod) return 1;
+    jclass cls = (*env)->FindClass(env,
+        "com/kdroid/composetray/lib/linux/LinuxNativeBridge$TrayEventDispatcher");
+    if (!cls) {
+        if ((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
+        return 0;
+    }
+    g_onTrayEventMethod = (*env)->GetMethodID(env, cls, "onTrayEvent", "(IIIIJ)V");
+    (*env)->DeleteLocalRef(env, cls);
+    if ((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
+    return g_onTrayEventMethod != NULL;
+}
 
-static CallbackEntry *g_clickCallback = NULL;
-static CallbackEntry *g_rclickCallback = NULL;
-static CallbackEntry *g_menuCallbacks = NULL;
-static CallbackEntry *g_menuOpenedCallback = NULL;
+/* Returns the context for a tray, creating it when create != 0.
+ * Caller must hold g_trayContextsLock. */
+static TrayContext *trayContextFor(sni_tray *tray, int create) {
+    for (TrayContext *c = g_trayContexts; c; c = c->next) {
+        if (c->tray == tray) return c;
+    }
+    if (!create) return NULL;
+    TrayContext *ctx = calloc(1, sizeof(TrayContext));
+    if (!ctx) return NULL;
+    ctx->tray = tray;
+    ctx->next = g_trayContexts;
+    g_trayContexts = ctx;
+    return ctx;
+}
 
-static void storeCallback(CallbackEntry **list, uintptr_t key, JNIEnv *env, jobject callback) {
-    /* Remove existing entry for this key */
-    CallbackEntry **pp = list;
+static void releaseTrayContext(JNIEnv *env, sni_tray *tray) {
+    pthread_mutex_lock(&g_trayContextsLock);
+    TrayContext **pp = &g_trayContexts;
     while (*pp) {
-        if ((*pp)->key == key) {
-            CallbackEntry *old = *pp;
+        if ((*pp)->tray == tray) {
+            TrayContext *old = *pp;
             *pp = old->next;
-            (*env)->DeleteGlobalRef(env, old->globalRef);
+            if (old->dispatcher && env) (*env)->DeleteGlobalRef(env, old->dispatcher);
             free(old);
             break;
         }
         pp = &(*pp)->next;
     }
-    if (callback == NULL) return;
-    CallbackEntry *entry = malloc(sizeof(CallbackEntry));
-    entry->key = key;
-    entry->globalRef = (*env)->NewGlobalRef(env, callback);
-    entry->next = *list;
-    *list = entry;
-}
-
-static jobject findCallback(CallbackEntry *list, uintptr_t key) {
-    for (CallbackEntry *e = list; e; e = e->next) {
-        if (e->key == key) return e->globalRef;
-    }
-    return NULL;
-}
-
-static void clearAllCallbacks(CallbackEntry **list) {
-    JNIEnv *env = getJNIEnv();
-    CallbackEntry *e = *list;
-    while (e) {
-        CallbackEntry *next = e->next;
-        if (env) (*env)->DeleteGlobalRef(env, e->globalRef);
-        free(e);
-        e = next;
-    }
-    *list = NULL;
+    pthread_mutex_unlock(&g_trayContextsLock);
 }
 
-/* ========================================================================== */
-/*  Runnable invocation helper                                                */
-/* ========================================================================== */
-
-/* Cached Runnable class and run() method ID.
- * Using the interface class (java.lang.Runnable) instead of GetObjectClass()
- * so GraalVM native-image can resolve the method without needing to register
- * every lambda class for JNI access. */
-static jclass g_runnableClass = NULL;
-static jmethodID g_runMethod = NULL;
-
-static void ensureRunnableCached(JNIEnv *env) {
-    if (g_runnableClass) return;
-    jclass cls = (*env)->FindClass(env, "java/lang/Runnable");
-    if (!cls) return;
-    g_runnableClass = (*env)->NewGlobalRef(env, cls);
-    g_runMethod = (*env)->GetMethodID(env, g_runnableClass, "run", "()V");
+static int64_t monotonicMillis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-static void invokeRunnable(jobject runnable) {
+static void dispatchEvent(TrayContext *ctx, jint type, jint itemId, jint x, jint y) {
+    if (!ctx || !ctx->dispatcher || !g_onTrayEventMethod) return;
     JNIEnv *env = getJNIEnv();
-    if (!env || !runnable) return;
-    ensureRunnableCached(env);
-    if (!g_runMethod) return;
-    (*env)->CallVoidMethod(env, runnable, g_runMethod);
+    if (!env) return;
+    (*env)->CallVoidMethod(env, ctx->dispatcher, g_onTrayEventMethod,
+                           type, itemId, x, y, (jlong)monotonicMillis());
     if ((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
 }
 
@@ -129,29 +145,44 @@ static void invokeRunnable(jobject runnable) {
 /* ========================================================================== */
 
 static void click_trampoline(int32_t x, int32_t y, void *userdata) {
-    (void)x; (void)y;
-    uintptr_t key = (uintptr_t)userdata;
-    jobject runnable = findCallback(g_clickCallback, key);
-    if (runnable) invokeRunnable(runnable);
+    dispatchEvent((TrayContext *)userdata, EVT_CLICK, 0, (jint)x, (jint)y);
 }
 
 static void rclick_trampoline(int32_t x, int32_t y, void *userdata) {
-    (void)x; (void)y;
-    uintptr_t key = (uintptr_t)userdata;
-    jobject runnable = findCallback(g_rclickCallback, key);
-    if (runnable) invokeRunnable(runnable);
+    dispatchEvent((TrayContext *)userdata, EVT_RCLICK, 0, (jint)x, (jint)y);
 }
 
 static void menu_item_trampoline(uint32_t id, void *userdata) {
-    (void)userdata;
-    jobject runnable = findCallback(g_menuCallbacks, (uintptr_t)id);
-    if (runnable) invokeRunnable(runnable);
+    dispatchEvent((TrayContext *)userdata, EVT_MENU_ITEM, (jint)id, 0, 0);
 }
 
 static void menu_opened_trampoline(void *userdata) {
-    uintptr_t key = (uintptr_t)userdata;
-    jobject runnable = findCallback(g_menuOpenedCallback, key);
-    if (runnable) invokeRunnable(runnable);
+    dispatchEvent((TrayContext *)userdata, EVT_MENU_OPENED, 0, 0, 0);
+}
+
+static void dclick_trampoline(int32_t x, int32_t y, void *userdata) {
+    dispatchEvent((TrayContext *)userdata, EVT_DOUBLE_CLICK, 0, (jint)x, (jint)y);
+}
+
+static void middle_click_trampoline(int32_t x, int32_t y, void *userdata) {
+    dispatchEvent((TrayContext *)userdata, EVT_MIDDLE_CLICK, 0, (jint)x, (jint)y);
+}
+
+static void scroll_trampoline(int32_t delta, int orientation, void *userdata) {
+    dispatchEvent((TrayContext *)userdata, EVT_SCROLL, 0, (jint)delta, (jint)orientation);
+}
+
+static void notification_trampoline(uint32_t token, int32_t action, int32_t reason,
+                                    void *userdata) {
+    dispatchEvent((TrayContext *)userdata, EVT_NOTIFICATION, (jint)token, (jint)action, (jint)reason);
+}
+
+static void host_trampoline(int present, void *userdata) {
+    dispatchEvent((TrayContext *)userdata, EVT_HOST, 0, (jint)present, 0);
+}
+
+static void color_scheme_trampoline(int32_t scheme, void *userdata) {
+    dispatchEvent((TrayContext *)userdata, EVT_COLOR_SCHEME, 0, (jint)scheme, 0);
 }
 
 /* ========================================================================== */
@@ -215,15 +246,8 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeDestroy(
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
     if (!tray) return;
 
-    /* Clean up all callbacks for this tray */
-    uintptr_t key = (uintptr_t)tray;
-    storeCallback(&g_clickCallback, key, env, NULL);
-    storeCallback(&g_rclickCallback, key, env, NULL);
-    storeCallback(&g_menuOpenedCallback, key, env, NULL);
-    /* Menu callbacks are keyed by item id, clear all */
-    clearAllCallbacks(&g_menuCallbacks);
-
     sni_tray_destroy(tray);
+    releaseTrayContext(env, tray);
 }
 
 /* ── Tray properties ────────────────────────────────────────────────── */
@@ -242,6 +266,31 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetIcon(
     (*env)->ReleaseByteArrayElements(env, iconBytes, buf, JNI_ABORT);
 }
 
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetIconPixmaps(
+    JNIEnv *env, jclass clazz, jlong handle, jbyteArray rgba, jintArray sizes)
+{
+    (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray || !rgba || !sizes) return;
+
+    jsize count = (*env)->GetArrayLength(env, sizes);
+    jint *sz = (*env)->GetIntArrayElements(env, sizes, NULL);
+    if (!sz) return;
+    int *isz = malloc(count > 0 ? (size_t)count * sizeof(int) : 1);
+    if (!isz) { (*env)->ReleaseIntArrayElements(env, sizes, sz, JNI_ABORT); return; }
+    for (jsize i = 0; i < count; i++) isz[i] = (int)sz[i];
+    (*env)->ReleaseIntArrayElements(env, sizes, sz, JNI_ABORT);
+
+    jsize len = (*env)->GetArrayLength(env, rgba);
+    jbyte *buf = (*env)->GetByteArrayElements(env, rgba, NULL);
+    if (buf) {
+        sni_tray_set_icon_pixmaps(tray, (const uint8_t *)buf, (size_t)len, isz, (int)count);
+        (*env)->ReleaseByteArrayElements(env, rgba, buf, JNI_ABORT);
+    }
+    free(isz);
+}
+
 JNIEXPORT void JNICALL
 Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetTitle(
     JNIEnv *env, jclass clazz, jlong handle, jstring title)
@@ -266,60 +315,172 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetTooltip(
     if (utf) (*env)->ReleaseStringUTFChars(env, tooltip, utf);
 }
 
-/* ── Callbacks ──────────────────────────────────────────────────────── */
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetFlushInterval(
+    JNIEnv *env, jclass clazz, jlong handle, jint intervalMs)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_set_flush_interval(tray, intervalMs > 0 ? (uint32_t)intervalMs : 0);
+}
 
 JNIEXPORT void JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetClickCallback(
-    JNIEnv *env, jclass clazz, jlong handle, jobject callback)
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeBeginUpdate(
+    JNIEnv *env, jclass clazz, jlong handle)
 {
-    (void)clazz;
+    (void)env; (void)clazz;
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
-    if (!tray) return;
-    uintptr_t key = (uintptr_t)tray;
-    storeCallback(&g_clickCallback, key, env, callback);
-    sni_tray_set_click_callback(tray,
-                                 callback ? click_trampoline : NULL,
-                                 (void *)key);
+    if (tray) sni_tray_begin_update(tray);
 }
 
 JNIEXPORT void JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetRClickCallback(
-    JNIEnv *env, jclass clazz, jlong handle, jobject callback)
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeEndUpdate(
+    JNIEnv *env, jclass clazz, jlong handle)
 {
-    (void)clazz;
+    (void)env; (void)clazz;
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
-    if (!tray) return;
-    uintptr_t key = (uintptr_t)tray;
-    storeCallback(&g_rclickCallback, key, env, callback);
-    sni_tray_set_rclick_callback(tray,
-                                  callback ? rclick_trampoline : NULL,
-                                  (void *)key);
+    if (tray) sni_tray_end_update(tray);
 }
 
 JNIEXPORT void JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetMenuItemCallback(
-    JNIEnv *env, jclass clazz, jlong handle, jint menuId, jobject callback)
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetStatus(
+    JNIEnv *env, jclass clazz, jlong handle, jint status)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_set_status(tray, (int)status);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetAttentionIcon(
+    JNIEnv *env, jclass clazz, jlong handle, jbyteArray iconBytes)
 {
     (void)clazz;
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
     if (!tray) return;
-    storeCallback(&g_menuCallbacks, (uintptr_t)menuId, env, callback);
-    /* Ensure the global menu callback trampoline is installed */
-    sni_tray_set_menu_callback(tray, menu_item_trampoline, (void *)(uintptr_t)tray);
+    if (!iconBytes) {
+        sni_tray_set_attention_icon(tray, NULL, 0);
+        return;
+    }
+    jsize len = (*env)->GetArrayLength(env, iconBytes);
+    jbyte *buf = (*env)->GetByteArrayElements(env, iconBytes, NULL);
+    sni_tray_set_attention_icon(tray, (const uint8_t *)buf, (size_t)len);
+    (*env)->ReleaseByteArrayElements(env, iconBytes, buf, JNI_ABORT);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetIconTemplate(
+    JNIEnv *env, jclass clazz, jlong handle, jboolean enabled)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_set_icon_template(tray, enabled ? 1 : 0);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetDarkMode(
+    JNIEnv *env, jclass clazz, jlong handle, jboolean dark)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_set_dark_mode(tray, dark ? 1 : 0);
 }
 
+/* ── Events ─────────────────────────────────────────────────────────── */
+
 JNIEXPORT void JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetMenuOpenedCallback(
-    JNIEnv *env, jclass clazz, jlong handle, jobject callback)
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetEventDispatcher(
+    JNIEnv *env, jclass clazz, jlong handle, jobject dispatcher)
 {
     (void)clazz;
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
     if (!tray) return;
-    uintptr_t key = (uintptr_t)tray;
-    storeCallback(&g_menuOpenedCallback, key, env, callback);
-    sni_tray_set_menu_opened_callback(tray,
-                                       callback ? menu_opened_trampoline : NULL,
-                                       (void *)key);
+    if (dispatcher && !ensureDispatcherCached(env)) return;
+
+    pthread_mutex_lock(&g_trayContextsLock);
+    TrayContext *ctx = trayContextFor(tray, dispatcher != NULL);
+    if (ctx) {
+        if (ctx->dispatcher) (*env)->DeleteGlobalRef(env, ctx->dispatcher);
+        ctx->dispatcher = dispatcher ? (*env)->NewGlobalRef(env, dispatcher) : NULL;
+    }
+    pthread_mutex_unlock(&g_trayContextsLock);
+
+    /* All native callbacks share the same context; the dispatcher tells
+     * events apart by type, so there is nothing to register per item. */
+    void *ud = (ctx && ctx->dispatcher) ? ctx : NULL;
+    sni_tray_set_click_callback(tray, ud ? click_trampoline : NULL, ud);
+    sni_tray_set_rclick_callback(tray, ud ? rclick_trampoline : NULL, ud);
+    sni_tray_set_menu_callback(tray, ud ? menu_item_trampoline : NULL, ud);
+    sni_tray_set_menu_opened_callback(tray, ud ? menu_opened_trampoline : NULL, ud);
+    sni_tray_set_color_scheme_callback(tray, ud ? color_scheme_trampoline : NULL, ud);
+    sni_tray_set_scroll_callback(tray, ud ? scroll_trampoline : NULL, ud);
+    sni_tray_set_dclick_callback(tray, ud ? dclick_trampoline : NULL, ud);
+    sni_tray_set_middle_click_callback(tray, ud ? middle_click_trampoline : NULL, ud);
+    sni_tray_set_notification_callback(tray, ud ? notification_trampoline : NULL, ud);
+    sni_tray_set_host_callback(tray, ud ? host_trampoline : NULL, ud);
+}
+
+/* ── Notifications ──────────────────────────────────────────────────── */
+
+JNIEXPORT jint JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeNotify(
+    JNIEnv *env, jclass clazz, jlong handle, jstring summary, jstring body,
+    jobjectArray actions, jboolean withIcon, jint timeoutMs)
+{
+    (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray) return 0;
+
+    const char *sum = summary ? (*env)->GetStringUTFChars(env, summary, NULL) : NULL;
+    const char *txt = body ? (*env)->GetStringUTFChars(env, body, NULL) : NULL;
+
+    /* sni_tray_notify() copies every string, so they are released right after */
+    jsize count = actions ? (*env)->GetArrayLength(env, actions) : 0;
+    if (count > 8) count = 8;
+    jstring jlabels[8];
+    const char *labels[8];
+    for (jsize i = 0; i < count; i++) {
+        jlabels[i] = (jstring)(*env)->GetObjectArrayElement(env, actions, i);
+        labels[i] = jlabels[i] ? (*env)->GetStringUTFChars(env, jlabels[i], NULL) : NULL;
+    }
+
+    uint32_t token = sni_tray_notify(tray, sum, txt, labels, (int)count,
+                                     withIcon ? 1 : 0, (int32_t)timeoutMs);
+
+    for (jsize i = 0; i < count; i++) {
+        if (labels[i]) (*env)->ReleaseStringUTFChars(env, jlabels[i], labels[i]);
+        if (jlabels[i]) (*env)->DeleteLocalRef(env, jlabels[i]);
+    }
+    if (txt) (*env)->ReleaseStringUTFChars(env, body, txt);
+    if (sum) (*env)->ReleaseStringUTFChars(env, summary, sum);
+    return (jint)token;
+}
+
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeSetDeferSingleClick(
+    JNIEnv *env, jclass clazz, jlong handle, jboolean enabled)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_set_defer_single_click(tray, enabled ? 1 : 0);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeGetHostPresent(
+    JNIEnv *env, jclass clazz, jlong handle)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    return (jint)sni_tray_get_host_present(tray);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeGetColorScheme(
+    JNIEnv *env, jclass clazz, jlong handle)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    return (jint)sni_tray_get_color_scheme(tray);
 }
 
 /* ── Click position ─────────────────────────────────────────────────── */
@@ -337,6 +498,33 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeGetLastClickXY(
     (*env)->SetIntArrayRegion(env, outXY, 0, 2, buf);
 }
 
+/* ── Stats ──────────────────────────────────────────────────────────── */
+
+/* outStats: [registrations, reconnects, recoveries, lastRecoveryMs, startupLatencyMs,
+ *            suppressedUpdates] */
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeGetStats(
+    JNIEnv *env, jclass clazz, jlong handle, jlongArray outStats)
+{
+    (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray || !outStats) return;
+    sni_tray_stats st;
+    memset(&st, 0, sizeof(st));
+    sni_tray_get_stats(tray, &st);
+    jlong buf[] = {
+        (jlong)st.registrations,
+        (jlong)st.reconnects,
+        (jlong)st.recoveries,
+        (jlong)st.last_recovery_ms,
+        (jlong)st.startup_latency_ms,
+        (jlong)st.suppressed_updates,
+    };
+    jsize n = (*env)->GetArrayLength(env, outStats);
+    jsize count = (jsize)(sizeof(buf) / sizeof(buf[0]));
+    (*env)->SetLongArrayRegion(env, outStats, 0, n < count ? n : count, buf);
+}
+
 /* ── Menu management ────────────────────────────────────────────────── */
 
 JNIEXPORT void JNICALL
@@ -346,8 +534,6 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeResetMenu(
     (void)env; (void)clazz;
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
     if (!tray) return;
-    /* Clear menu item callbacks */
-    clearAllCallbacks(&g_menuCallbacks);
     sni_tray_reset_menu(tray);
 }
 
@@ -431,6 +617,43 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeAddSubSeparator(
     if (tray) sni_tray_add_sub_separator(tray, (uint32_t)parentId);
 }
 
+JNIEXPORT jint JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeInsertMenuItem(
+    JNIEnv *env, jclass clazz, jlong handle, jint parentId, jint beforeId,
+    jstring title, jboolean checkable, jboolean checked, jboolean separator)
+{
+    (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray) return 0;
+    const char *t = title ? (*env)->GetStringUTFChars(env, title, NULL) : NULL;
+    uint32_t id = sni_tray_insert_menu_item(tray, (uint32_t)parentId, (uint32_t)beforeId, t,
+                                            checkable ? 1 : 0, checked ? 1 : 0,
+                                            separator ? 1 : 0);
+    if (t) (*env)->ReleaseStringUTFChars(env, title, t);
+    return (jint)id;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeMoveMenuItem(
+    JNIEnv *env, jclass clazz, jlong handle, jint id, jint parentId, jint beforeId)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray) return JNI_FALSE;
+    return sni_tray_move_menu_item(tray, (uint32_t)id, (uint32_t)parentId, (uint32_t)beforeId)
+               ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeRemoveMenuItem(
+    JNIEnv *env, jclass clazz, jlong handle, jint id)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray) return JNI_FALSE;
+    return sni_tray_remove_menu_item(tray, (uint32_t)id) ? JNI_TRUE : JNI_FALSE;
+}
+
 /* ── Per-item operations ────────────────────────────────────────────── */
 
 JNIEXPORT jint JNICALL
@@ -500,19 +723,54 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeItemUncheck(
     if (tray) sni_tray_item_uncheck(tray, (uint32_t)id);
 }
 
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeItemSetRadioGroup(
+    JNIEnv *env, jclass clazz, jlong handle, jint id, jint group)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_item_set_radio_group(tray, (uint32_t)id, (uint32_t)group);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeGroupSelect(
+    JNIEnv *env, jclass clazz, jlong handle, jint group, jint id)
+{
+    (void)env; (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (tray) sni_tray_group_select(tray, (uint32_t)group, (uint32_t)id);
+}
+
 JNIEXPORT void JNICALL
 Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeItemSetIcon(
     JNIEnv *env, jclass clazz, jlong handle, jint id, jbyteArray iconBytes)
 {
     (void)clazz;
     sni_tray *tray = (sni_tray *)(uintptr_t)handle;
-    if (!tray || !iconBytes) return;
+    if (!tray) return;
+    if (!iconBytes) {
+        sni_tray_item_set_icon(tray, (uint32_t)id, NULL, 0);  /* clears the icon */
+        return;
+    }
     jsize len = (*env)->GetArrayLength(env, iconBytes);
     jbyte *buf = (*env)->GetByteArrayElements(env, iconBytes, NULL);
     sni_tray_item_set_icon(tray, (uint32_t)id, (const uint8_t *)buf, (size_t)len);
     (*env)->ReleaseByteArrayElements(env, iconBytes, buf, JNI_ABORT);
 }
 
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeItemSetIconTemplate(
+    JNIEnv *env, jclass clazz, jlong handle, jint id, jbyteArray iconBytes)
+{
+    (void)clazz;
+    sni_tray *tray = (sni_tray *)(uintptr_t)handle;
+    if (!tray || !iconBytes) return;
+    jsize len = (*env)->GetArrayLength(env, iconBytes);
+    jbyte *buf = (*env)->GetByteArrayElements(env, iconBytes, NULL);
+    sni_tray_item_set_icon_template(tray, (uint32_t)id, (const uint8_t *)buf, (size_t)len);
+    (*env)->ReleaseByteArrayElements(env, iconBytes, buf, JNI_ABORT);
+}
+
 JNIEXPORT void JNICALL
 Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeItemSetShortcut(
     JNIEnv *env, jclass clazz, jlong handle, jint id,
@@ -529,7 +787,7 @@ Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeItemSetShortcut(
 }
 
 /* ========================================================================== */
-/*  X11 outside-click watcher (dynamically loaded to avoid hard dependency)   */
+/*  X11 bindings (dynamically loaded to avoid hard dependency)                */
 /* ========================================================================== */
 
 /* X11 types */
@@ -537,6 +795,50 @@ typedef void *X11Display;
 typedef unsigned long X11Window;
 typedef int X11Bool;
 
+/* XEvent is a union padded to 24 longs */
+typedef union {
+    int  type;
+    long pad[24];
+} X11Event;
+
+/* XGenericEventCookie (X11/Xlib.h) */
+typedef struct {
+    int           type;
+    unsigned long serial;
+    X11Bool       send_event;
+    X11Display    display;
+    int           extension;
+    int           evtype;
+    unsigned int  cookie;
+    void         *data;
+} X11GenericEventCookie;
+
+/* Leading fields of XIRawEvent (X11/extensions/XInput2.h) */
+typedef struct {
+    int           type;
+    unsigned long serial;
+    X11Bool       send_event;
+    X11Display    display;
+    int           extension;
+    int           evtype;
+    unsigned long time;
+    int           deviceid;
+    int           sourceid;
+    int           detail;   /* button number */
+    int           flags;
+} X11IRawEvent;
+
+/* XIEventMask */
+typedef struct {
+    int            deviceid;
+    int            mask_len;
+    unsigned char *mask;
+} X11IEventMask;
+
+#define X11_GENERIC_EVENT        35
+#define XI_ALL_MASTER_DEVICES    1
+#define XI_RAW_BUTTON_PRESS      15
+
 /* X11 function pointers (loaded via dlopen/dlsym) */
 typedef X11Display (*fn_XOpenDisplay)(const char *);
 typedef X11Window  (*fn_XDefaultRootWindow)(X11Display);
@@ -545,12 +847,32 @@ typedef X11Bool    (*fn_XQueryPointer)(X11Display, X11Window,
                                       int *, int *, int *, int *,
                                       unsigned int *);
 typedef int        (*fn_XCloseDisplay)(X11Display);
+typedef X11Bool    (*fn_XQueryExtension)(X11Display, const char *, int *, int *, int *);
+typedef int        (*fn_XPending)(X11Display);
+typedef int        (*fn_XNextEvent)(X11Display, X11Event *);
+typedef int        (*fn_XConnectionNumber)(X11Display);
+typedef X11Bool    (*fn_XGetEventData)(X11Display, X11GenericEventCookie *);
+typedef void       (*fn_XFreeEventData)(X11Display, X11GenericEventCookie *);
+typedef int        (*fn_XFlush)(X11Display);
+typedef int        (*fn_XIQueryVersion)(X11Display, int *, int *);
+typedef int        (*fn_XISelectEvents)(X11Display, X11Window, X11IEventMask *, int);
 
 static void        *g_x11_lib = NULL;
 static fn_XOpenDisplay       g_XOpenDisplay = NULL;
 static fn_XDefaultRootWindow g_XDefaultRootWindow = NULL;
 static fn_XQueryPointer      g_XQueryPointer = NULL;
 static fn_XCloseDisplay      g_XCloseDisplay = NULL;
+static fn_XQueryExtension    g_XQueryExtension = NULL;
+static fn_XPending           g_XPending = NULL;
+static fn_XNextEvent         g_XNextEvent = NULL;
+static fn_XConnectionNumber  g_XConnectionNumber = NULL;
+static fn_XGetEventData      g_XGetEventData = NULL;
+static fn_XFreeEventData     g_XFreeEventData = NULL;
+static fn_XFlush             g_XFlush = NULL;
+
+static void        *g_xi_lib = NULL;
+static fn_XIQueryVersion     g_XIQueryVersion = NULL;
+static fn_XISelectEvents     g_XISelectEvents = NULL;
 
 static int ensure_x11(void) {
     if (g_x11_lib) return 1;
@@ -566,60 +888,256 @@ static int ensure_x11(void) {
         g_x11_lib = NULL;
         return 0;
     }
+    /* Event-loop entry points, only needed by the XInput2 watcher */
+    g_XQueryExtension    = (fn_XQueryExtension)dlsym(g_x11_lib, "XQueryExtension");
+    g_XPending           = (fn_XPending)dlsym(g_x11_lib, "XPending");
+    g_XNextEvent         = (fn_XNextEvent)dlsym(g_x11_lib, "XNextEvent");
+    g_XConnectionNumber  = (fn_XConnectionNumber)dlsym(g_x11_lib, "XConnectionNumber");
+    g_XGetEventData      = (fn_XGetEventData)dlsym(g_x11_lib, "XGetEventData");
+    g_XFreeEventData     = (fn_XFreeEventData)dlsym(g_x11_lib, "XFreeEventData");
+    g_XFlush             = (fn_XFlush)dlsym(g_x11_lib, "XFlush");
     return 1;
 }
 
-JNIEXPORT jlong JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeX11OpenDisplay(
-    JNIEnv *env, jclass clazz)
-{
-    (void)env; (void)clazz;
+/* libXi is optional: without it the watcher falls back to pointer polling. */
+static int ensure_xi(void) {
     if (!ensure_x11()) return 0;
-    X11Display dpy = g_XOpenDisplay(NULL);
-    return (jlong)(uintptr_t)dpy;
+    if (!g_XQueryExtension || !g_XPending || !g_XNextEvent || !g_XConnectionNumber ||
+        !g_XGetEventData || !g_XFreeEventData || !g_XFlush) return 0;
+    if (g_xi_lib) return 1;
+    g_xi_lib = dlopen("libXi.so.6", RTLD_LAZY);
+    if (!g_xi_lib) g_xi_lib = dlopen("libXi.so", RTLD_LAZY);
+    if (!g_xi_lib) return 0;
+    g_XIQueryVersion = (fn_XIQueryVersion)dlsym(g_xi_lib, "XIQueryVersion");
+    g_XISelectEvents = (fn_XISelectEvents)dlsym(g_xi_lib, "XISelectEvents");
+    if (!g_XIQueryVersion || !g_XISelectEvents) {
+        dlclose(g_xi_lib);
+        g_xi_lib = NULL;
+        return 0;
+    }
+    return 1;
 }
 
-JNIEXPORT jlong JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeX11DefaultRootWindow(
-    JNIEnv *env, jclass clazz, jlong displayHandle)
-{
-    (void)env; (void)clazz;
-    if (!g_XDefaultRootWindow) return 0;
-    X11Display dpy = (X11Display)(uintptr_t)displayHandle;
-    if (!dpy) return 0;
-    return (jlong)g_XDefaultRootWindow(dpy);
+/* ========================================================================== */
+/*  Outside-click watcher (XInput2 or pointer polling, own thread/connection) */
+/* ========================================================================== */
+
+/* Raw button presses are delivered to the root window regardless of which
+ * client (or grab) receives the real event, so one subscription sees every
+ * click on the screen. The thread sleeps in poll() between events and only
+ * upcalls for presses outside the registered rectangles.
+ *
+ * Without libXi (or the extension) the same thread samples XQueryPointer at
+ * ~60 Hz instead and fires on the Button1 rising edge. Either way hit-testing
+ * runs here against rectangles pushed from Kotlin only when they change. */
+
+typedef struct {
+    jint x, y, w, h;
+} HitRect;
+
+typedef struct XiWatcher {
+    X11Display      dpy;
+    X11Window       root;
+    int             xi_opcode;
+    pthread_t       thread;
+    int             wake_pipe[2];
+    volatile int    running;
+    int             poll_mode;     /* no XInput2: sample the pointer instead */
+    jobject         callback;      /* GlobalRef to OutsideClickCallback */
+
+    pthread_mutex_t lock;          /* guards rects */
+    HitRect        *rects;
+    int             rect_count;
+} XiWatcher;
+
+static jmethodID g_onOutsideClickMethod = NULL;
+
+static int ensureOutsideClickCached(JNIEnv *env) {
+    if (g_onOutsideClickMethod) return 1;
+    jclass cls = (*env)->FindClass(env,
+        "com/kdroid/composetray/lib/linux/LinuxNativeBridge$OutsideClickCallback");
+    if (!cls) {
+        if ((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
+        return 0;
+    }
+    g_onOutsideClickMethod = (*env)->GetMethodID(env, cls, "onOutsideClick", "(II)V");
+    (*env)->DeleteLocalRef(env, cls);
+    if ((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
+    return g_onOutsideClickMethod != NULL;
 }
 
-JNIEXPORT jint JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeX11QueryPointer(
-    JNIEnv *env, jclass clazz, jlong displayHandle, jlong rootWindow, jintArray outData)
-{
-    (void)clazz;
-    if (!g_XQueryPointer) return 0;
-    X11Display dpy = (X11Display)(uintptr_t)displayHandle;
-    if (!dpy || !outData) return 0;
+static int xi_point_in_rects(XiWatcher *w, int x, int y) {
+    int inside = 0;
+    pthread_mutex_lock(&w->lock);
+    for (int i = 0; i < w->rect_count && !inside; i++) {
+        const HitRect *r = &w->rects[i];
+        inside = x >= r->x && x < r->x + r->w && y >= r->y && y < r->y + r->h;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return inside;
+}
+
+static void xi_report_press(XiWatcher *w, JNIEnv *env, int root_x, int root_y) {
+    if (xi_point_in_rects(w, root_x, root_y)) return;
+    if (!env) return;
+    (*env)->CallVoidMethod(env, w->callback, g_onOutsideClickMethod, (jint)root_x, (jint)root_y);
+    if ((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
+}
 
+static void xi_handle_press(XiWatcher *w, JNIEnv *env) {
+    /* Raw events carry no screen position: ask the server once, per press */
     X11Window root_ret, child_ret;
     int root_x, root_y, win_x, win_y;
     unsigned int mask;
+    if (!g_XQueryPointer(w->dpy, w->root, &root_ret, &child_ret,
+                         &root_x, &root_y, &win_x, &win_y, &mask)) return;
+    xi_report_press(w, env, root_x, root_y);
+}
 
-    X11Bool ok = g_XQueryPointer(dpy, (X11Window)(unsigned long)rootWindow,
-                                 &root_ret, &child_ret,
-                                 &root_x, &root_y, &win_x, &win_y, &mask);
+#define X11_BUTTON1_MASK   (1u << 8)
+#define POINTER_POLL_MS    16
+
+static void pointer_poll_loop(XiWatcher *w, JNIEnv *env) {
+    struct pollfd wake = {.fd = w->wake_pipe[0], .events = POLLIN};
+    int prev_left = 0;
+    while (w->running) {
+        X11Window root_ret, child_ret;
+        int root_x, root_y, win_x, win_y;
+        unsigned int mask;
+        if (g_XQueryPointer(w->dpy, w->root, &root_ret, &child_ret,
+                            &root_x, &root_y, &win_x, &win_y, &mask)) {
+            int left = (mask & X11_BUTTON1_MASK) != 0;
+            if (left && !prev_left) xi_report_press(w, env, root_x, root_y);
+            prev_left = left;
+        }
+        if (poll(&wake, 1, POINTER_POLL_MS) < 0 && errno != EINTR) break;
+    }
+}
 
-    /* outData: [rootX, rootY, mask] */
-    jint buf[3] = {(jint)root_x, (jint)root_y, (jint)mask};
-    (*env)->SetIntArrayRegion(env, outData, 0, 3, buf);
+static void *xi_watcher_thread(void *arg) {
+    XiWatcher *w = arg;
+    JNIEnv *env = getJNIEnv();
+    if (w->poll_mode) {
+        pointer_poll_loop(w, env);
+        if (g_jvm) (*g_jvm)->DetachCurrentThread(g_jvm);
+        return NULL;
+    }
+    struct pollfd fds[2] = {
+        {.fd = g_XConnectionNumber(w->dpy), .events = POLLIN},
+        {.fd = w->wake_pipe[0], .events = POLLIN},
+    };
+
+    while (w->running) {
+        while (w->running && g_XPending(w->dpy) > 0) {
+            X11Event ev;
+            g_XNextEvent(w->dpy, &ev);
+            X11GenericEventCookie *cookie = (X11GenericEventCookie *)&ev;
+            if (cookie->type != X11_GENERIC_EVENT || cookie->extension != w->xi_opcode) continue;
+            if (!g_XGetEventData(w->dpy, cookie)) continue;
+            if (cookie->evtype == XI_RAW_BUTTON_PRESS) {
+                const X11IRawEvent *raw = cookie->data;
+                if (raw->detail == 1) xi_handle_press(w, env); /* left button */
+            }
+            g_XFreeEventData(w->dpy, cookie);
+        }
+        if (!w->running) break;
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+    }
 
-    return (jint)(ok != 0 ? 1 : 0);
+    if (g_jvm) (*g_jvm)->DetachCurrentThread(g_jvm);
+    return NULL;
 }
 
+static void xi_watcher_free(JNIEnv *env, XiWatcher *w) {
+    if (w->dpy) g_XCloseDisplay(w->dpy);
+    if (w->wake_pipe[0] >= 0) close(w->wake_pipe[0]);
+    if (w->wake_pipe[1] >= 0) close(w->wake_pipe[1]);
+    if (w->callback && env) (*env)->DeleteGlobalRef(env, w->callback);
+    pthread_mutex_destroy(&w->lock);
+    free(w->rects);
+    free(w);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeXiWatcherStart(
+    JNIEnv *env, jclass clazz, jobject callback)
+{
+    (void)clazz;
+    if (!callback || !ensure_x11() || !ensureOutsideClickCached(env)) return 0;
+
+    XiWatcher *w = calloc(1, sizeof(XiWatcher));
+    if (!w) return 0;
+    w->wake_pipe[0] = w->wake_pipe[1] = -1;
+    pthread_mutex_init(&w->lock, NULL);
+
+    w->dpy = g_XOpenDisplay(NULL);
+    if (!w->dpy) { xi_watcher_free(env, w); return 0; }
+    w->root = g_XDefaultRootWindow(w->dpy);
+
+    int event_base, error_base, major = 2, minor = 2;
+    if (!ensure_xi() ||
+        !g_XQueryExtension(w->dpy, "XInputExtension", &w->xi_opcode, &event_base, &error_base) ||
+        g_XIQueryVersion(w->dpy, &major, &minor) != 0 || major < 2) {
+        w->poll_mode = 1;
+    } else {
+        unsigned char mask_bits[4] = {0};
+        mask_bits[XI_RAW_BUTTON_PRESS >> 3] |= (unsigned char)(1 << (XI_RAW_BUTTON_PRESS & 7));
+        X11IEventMask mask = {XI_ALL_MASTER_DEVICES, (int)sizeof(mask_bits), mask_bits};
+        g_XISelectEvents(w->dpy, w->root, &mask, 1);
+        g_XFlush(w->dpy);
+    }
+
+    if (pipe(w->wake_pipe) < 0) {
+        w->wake_pipe[0] = w->wake_pipe[1] = -1;
+        xi_watcher_free(env, w);
+        return 0;
+    }
+    fcntl(w->wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    w->callback = (*env)->NewGlobalRef(env, callback);
+    w->running = 1;
+    if (pthread_create(&w->thread, NULL, xi_watcher_thread, w) != 0) {
+        xi_watcher_free(env, w);
+        return 0;
+    }
+    return (jlong)(uintptr_t)w;
+}
+
+/* rects: flattened [x, y, width, height] * n in root-window coordinates.
+ * Presses inside any of them are ignored. */
 JNIEXPORT void JNICALL
-Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeX11CloseDisplay(
-    JNIEnv *env, jclass clazz, jlong displayHandle)
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeXiWatcherSetRects(
+    JNIEnv *env, jclass clazz, jlong handle, jintArray rects)
 {
-    (void)env; (void)clazz;
-    if (!g_XCloseDisplay) return;
-    X11Display dpy = (X11Display)(uintptr_t)displayHandle;
-    if (dpy) g_XCloseDisplay(dpy);
+    (void)clazz;
+    XiWatcher *w = (XiWatcher *)(uintptr_t)handle;
+    if (!w) return;
+
+    int count = rects ? (*env)->GetArrayLength(env, rects) / 4 : 0;
+    HitRect *copy = NULL;
+    if (count > 0) {
+        copy = malloc((size_t)count * sizeof(HitRect));
+        if (!copy) return;
+        (*env)->GetIntArrayRegion(env, rects, 0, count * 4, (jint *)copy);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    free(w->rects);
+    w->rects = copy;
+    w->rect_count = count;
+    pthread_mutex_unlock(&w->lock);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kdroid_composetray_lib_linux_LinuxNativeBridge_nativeXiWatcherStop(
+    JNIEnv *env, jclass clazz, jlong handle)
+{
+    (void)clazz;
+    XiWatcher *w = (XiWatcher *)(uintptr_t)handle;
+    if (!w) return;
+    w->running = 0;
+    char c = 1;
+    if (write(w->wake_pipe[1], &c, 1) < 0) { /* ignore */ }
+    pthread_join(w->thread, NULL);
+    xi_watcher_free(env, w);
 }
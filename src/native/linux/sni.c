@@ -12,9 +12,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include <time.h>
 #include <systemd/sd-bus.h>
@@ -41,9 +44,43 @@
 #define WATCHER_BUS       "org.kde.StatusNotifierWatcher"
 #define WATCHER_PATH      "/StatusNotifierWatcher"
 #define WATCHER_IFACE     "org.kde.StatusNotifierWatcher"
+#define DBUS_BUS          "org.freedesktop.DBus"
+#define DBUS_PATH         "/org/freedesktop/DBus"
+#define DBUS_IFACE        "org.freedesktop.DBus"
+#define PROPERTIES_IFACE  "org.freedesktop.DBus.Properties"
+#define PORTAL_BUS        "org.freedesktop.portal.Desktop"
+#define PORTAL_PATH       "/org/freedesktop/portal/desktop"
+#define PORTAL_SETTINGS   "org.freedesktop.portal.Settings"
+#define APPEARANCE_NS     "org.freedesktop.appearance"
+#define NOTIFY_BUS        "org.freedesktop.Notifications"
+#define NOTIFY_PATH       "/org/freedesktop/Notifications"
+#define NOTIFY_IFACE      "org.freedesktop.Notifications"
 
 #define MAX_MENU_ITEMS    512
+#define MAX_PENDING_PROPS 16   /* item ids per ItemsPropertiesUpdated before falling back to a relayout */
 #define DCLICK_INTERVAL   500  /* ms */
+#define DEFAULT_FLUSH_INTERVAL_MS 16  /* one frame at 60 Hz */
+#define RECONNECT_MIN_MS  250   /* first retry delay after losing the bus */
+#define RECONNECT_MAX_MS  8000  /* backoff ceiling */
+#define NOTIFY_QUEUE      32    /* unsent notifications before the oldest is dropped */
+#define NOTIFY_TRACKED    64    /* shown notifications still routed to the callback */
+#define NOTIFY_MAX_ACTIONS 8
+#define DEFAULT_NOTIFY_BURST       4
+#define DEFAULT_NOTIFY_INTERVAL_MS 250  /* one more Notify per interval after a burst */
+
+/* Pending change notifications, flushed by the event loop (see flush_dirty). */
+enum {
+    DIRTY_ICON    = 1 << 0,  /* NewIcon + ToolTip (the tooltip embeds the icon) */
+    DIRTY_TITLE   = 1 << 1,  /* NewTitle */
+    DIRTY_TOOLTIP = 1 << 2,  /* PropertiesChanged: ToolTip */
+    DIRTY_MENU    = 1 << 3,  /* PropertiesChanged: Menu (GNOME menu path quirk) */
+    DIRTY_LAYOUT  = 1 << 4,  /* LayoutUpdated + PropertiesChanged: Version */
+    DIRTY_STATUS  = 1 << 5,  /* NewStatus */
+    DIRTY_ATTENTION = 1 << 6, /* NewAttentionIcon */
+    DIRTY_ITEMS   = 1 << 7,  /* ItemsPropertiesUpdated for pending_prop_ids */
+    DIRTY_ALL     = DIRTY_ICON | DIRTY_TITLE | DIRTY_TOOLTIP | DIRTY_MENU | DIRTY_LAYOUT |
+                    DIRTY_STATUS | DIRTY_ATTENTION,
+};
 
 /* Icon target sizes for multi-resolution pixmap (matches Go implementation) */
 static const int ICON_SIZES[] = {16, 22, 24, 32, 48, 64, 128};
@@ -60,12 +97,16 @@ typedef struct menu_item {
     int      disabled;
     int      checked;
     int      checkable;
+    uint32_t radio_group; /* 0 = checkmark; otherwise exclusive within the group */
     int      visible;
     int      is_separator;
 
     /* Per-item icon raw PNG/JPG data */
     uint8_t *icon_data;
     size_t   icon_len;
+    uint64_t icon_hash;  /* content hash of icon_data, for no-op detection */
+    int      icon_template; /* icon_data is a mask PNG tinted by the dark mode */
+    size_t   icon_plte_off; /* offset of the PLTE payload in a template icon */
 
     /* Keyboard shortcut hint (display-only, DBusMenu "shortcut" property) */
     char    *shortcut_key;      /* e.g. "s", "F1", "Delete" */
@@ -122,6 +163,28 @@ static desktop_env detect_desktop(void) {
     return DE_UNKNOWN;
 }
 
+/* ========================================================================== */
+/*  Notifications                                                             */
+/* ========================================================================== */
+
+/* A Notify call waiting for the rate limiter */
+typedef struct {
+    uint32_t token;
+    char    *summary;
+    char    *body;
+    char    *actions[NOTIFY_MAX_ACTIONS]; /* labels; the action key is the index */
+    int      action_count;
+    int      with_icon;
+    int32_t  timeout_ms;
+} notify_req;
+
+/* A sent notification, matched to its signals by server id */
+typedef struct {
+    uint32_t token;
+    uint32_t server_id;  /* 0 until the Notify reply arrives */
+    uint64_t cookie;     /* of the Notify call, to match the reply */
+} notify_track;
+
 /* ========================================================================== */
 /*  Tray state                                                                */
 /* ========================================================================== */
@@ -132,9 +195,30 @@ struct sni_tray {
     sd_bus_slot *menu_slot;
     sd_bus_slot *sni_prop_slot;
     sd_bus_slot *menu_prop_slot;
+    sd_bus_slot *watcher_slot;   /* NameOwnerChanged match for the watcher */
+    sd_bus_slot *register_slot;  /* in-flight RegisterStatusNotifierItem */
+    sd_bus_slot *portal_slot;    /* Settings.SettingChanged match */
+    sd_bus_slot *portal_read_slot; /* in-flight initial color-scheme read */
+    sd_bus_slot *host_slot;      /* watcher StatusNotifierHostRegistered */
+    sd_bus_slot *host_gone_slot; /* watcher StatusNotifierHostUnregistered */
+    sd_bus_slot *host_read_slot; /* in-flight IsStatusNotifierHostRegistered read */
+    sd_bus_slot *notify_action_slot; /* Notifications.ActionInvoked match */
+    sd_bus_slot *notify_closed_slot; /* Notifications.NotificationClosed match */
     char        *bus_name;     /* org.kde.StatusNotifierItem-{PID}-1 */
     int          running;
-    int          quit_pipe[2]; /* write to [1] to wake the event loop */
+    int          wake_pipe[2]; /* write to [1] to wake the event loop */
+
+    /* Guards all state below against the JVM threads calling the setters.
+     * The event loop holds it while dispatching D-Bus messages and releases
+     * it around callbacks into the JVM. Only the loop thread touches the bus. */
+    pthread_mutex_t lock;
+
+    /* Signal coalescing: setters only record what changed; the loop emits
+     * at most once per flush interval, so intermediate states are dropped. */
+    uint32_t     dirty;             /* DIRTY_* bits awaiting emission */
+    uint32_t     flush_interval_ms;
+    int64_t      last_flush_ms;
+    int          update_depth;      /* open begin/end_update pairs: no flush */
 
     /* SNI properties */
     char        *title;
@@ -142,20 +226,52 @@ struct sni_tray {
 
     /* Icon: decoded pixmap list */
     pixmap_list  icon_pixmaps;
+    uint32_t     icon_generation;  /* bumped by every set_icon; stale decodes are dropped */
+    uint64_t     icon_hash;        /* content hash of the encoded bytes last applied */
+    int          icon_template;    /* keep the alpha, paint every pixel in the tint */
+    int          status;           /* SNI_STATUS_* */
+    pixmap_list  attention_pixmaps; /* decoded ahead of time, shown on NeedsAttention */
+    uint64_t     attention_hash;
+    int          dark;             /* panel is dark: template icons are white */
+
+    /* Initial icon decode runs on a worker so create() returns immediately
+     * and the loop thread can connect in parallel. */
+    pthread_t    decode_thread;
+    int          decode_started;
+    uint8_t     *pending_icon;     /* owned by the worker until it finishes */
+    size_t       pending_icon_len;
+    int64_t      created_ms;
 
     /* Menu state */
     menu_item   *items;        /* flat array of all items */
     int          item_count;
     int          item_capacity;
+    int32_t     *item_index;   /* id -> position in items, -1 once removed */
+    uint32_t     index_capacity;
     uint32_t     next_id;
     uint32_t     menu_version;
 
+    /* Radio groups: selected item id per group id, reset with the menu */
+    int32_t     *group_selected;
+    uint32_t     group_capacity;
+
+    /* Items whose toggle-state changed without a layout change */
+    int32_t      pending_prop_ids[MAX_PENDING_PROPS];
+    int          pending_prop_count;
+
     /* Click state */
     pthread_mutex_t click_lock;
     int32_t      last_click_x;
     int32_t      last_click_y;
     int64_t      last_activate_ms;
 
+    /* Deferred single click (sni_tray_set_defer_single_click): held until the
+     * double-click window has passed, then delivered by the event loop. */
+    int          defer_single_click;
+    int64_t      pending_click_due_ms;  /* 0 = nothing pending */
+    int32_t      pending_click_x;
+    int32_t      pending_click_y;
+
     /* Callbacks */
     sni_click_cb      on_click;
     void             *on_click_data;
@@ -165,10 +281,52 @@ struct sni_tray {
     void             *on_menu_item_data;
     sni_menu_opened_cb on_menu_opened;
     void              *on_menu_opened_data;
+    sni_color_scheme_cb on_color_scheme;
+    void               *on_color_scheme_data;
     int64_t            last_layout_updated_ms; /* suppress AboutToShow triggered by LayoutUpdated */
+    sni_click_cb       on_dclick;
+    void              *on_dclick_data;
+    sni_click_cb       on_middle_click;
+    void              *on_middle_click_data;
+    sni_scroll_cb      on_scroll;
+    void              *on_scroll_data;
+
+    /* Wheel deltas summed per orientation (SNI_SCROLL_*) and delivered at most
+     * once per flush interval, so a touchpad burst is one upcall per frame. */
+    int32_t      scroll_delta[2];
+    int64_t      scroll_due_ms;     /* 0 = nothing pending */
+
+    /* Notifications: a bounded queue drained by the loop through a token
+     * bucket, so a burst is sent as fast as allowed and then paced. */
+    sni_notification_cb on_notification;
+    void              *on_notification_data;
+    notify_req   notify_queue[NOTIFY_QUEUE];
+    int          notify_head;
+    int          notify_count;
+    notify_track notify_tracked[NOTIFY_TRACKED]; /* ring; the oldest is forgotten */
+    int          notify_tracked_next;
+    uint32_t     notify_next_token;
+    int          notify_burst;
+    int          notify_interval_ms;
+    int          notify_tokens;
+    int64_t      notify_refill_ms;
+
+    /* Whether any StatusNotifierHost is registered with the watcher: -1 until
+     * known. While 0, updates only accumulate in `dirty`; nothing is emitted. */
+    int          host_present;
+    int          host_reported;   /* last value given to on_host, -1 if none */
+    sni_host_cb  on_host;
+    void        *on_host_data;
+
+    /* Connection health: set when the bus drops or the watcher goes away,
+     * cleared once the watcher accepted our registration again. */
+    int64_t      lost_at_ms;
+    int          reconnect_delay_ms;
+    sni_tray_stats stats;
 
     /* Desktop environment */
     desktop_env  de;
+    int32_t      color_scheme;   /* SNI_COLOR_SCHEME_*, from the settings portal */
 
     /* Menu path currently advertised in SNI Menu property.
      * GNOME quirk: "/" when no menu, "/StatusNotifierMenu" when items exist. */
@@ -187,6 +345,26 @@ static int64_t now_ms(void) {
     return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+/* ========================================================================== */
+/*  Change detection helpers                                                  */
+/* ========================================================================== */
+
+/* FNV-1a 64-bit: cheap content hash for icon bytes. */
+static uint64_t hash_bytes(const uint8_t *data, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* NULL-safe string equality */
+static int str_equal(const char *a, const char *b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
 /* ========================================================================== */
 /*  Icon / Pixmap helpers                                                     */
 /* ========================================================================== */
@@ -254,15 +432,207 @@ static pixmap_list build_pixmaps(const uint8_t *data, size_t len) {
     return pl;
 }
 
+/* Take ready-made square RGBA images, smallest first, laid out back to back.
+ * No decode and no resampling: the caller already produced every size. */
+static pixmap_list pixmaps_from_rgba(const uint8_t *rgba, size_t len,
+                                     const int *sizes, int count) {
+    pixmap_list pl = {NULL, 0};
+    if (!rgba || !sizes || count <= 0) return pl;
+
+    size_t need = 0;
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] <= 0) return pl;
+        need += (size_t)sizes[i] * sizes[i] * 4;
+    }
+    if (need != len) return pl;
+
+    pl.entries = calloc((size_t)count, sizeof(pixmap));
+    if (!pl.entries) return pl;
+
+    const uint8_t *p = rgba;
+    for (int i = 0; i < count; i++) {
+        int s = sizes[i];
+        uint8_t *argb = rgba_to_argb32_be(p, s, s);
+        p += (size_t)s * s * 4;
+        if (!argb) continue;
+
+        pl.entries[pl.count].width = s;
+        pl.entries[pl.count].height = s;
+        pl.entries[pl.count].data = argb;
+        pl.entries[pl.count].data_len = (size_t)s * s * 4;
+        pl.count++;
+    }
+    return pl;
+}
+
+/* ========================================================================== */
+/*  Template (monochrome) icons                                               */
+/* ========================================================================== */
+
+/* A template icon only contributes its shape: the alpha channel is kept and
+ * every pixel gets the tint, white on a dark panel and black on a light one.
+ * The tint is re-applied in place on a theme flip, with no decoding. */
+
+static uint8_t template_tint(const sni_tray *tray) {
+    return tray->dark ? 0xFF : 0x00;
+}
+
+static void tint_pixmap_list(pixmap_list *pl, uint8_t v) {
+    for (int i = 0; i < pl->count; i++) {
+        uint8_t *p = pl->entries[i].data;
+        size_t n = pl->entries[i].data_len / 4;
+        for (size_t j = 0; j < n; j++) {
+            p[j * 4 + 1] = v;
+            p[j * 4 + 2] = v;
+            p[j * 4 + 3] = v;
+        }
+    }
+}
+
+/* Menu icons travel as encoded images (DBusMenu icon-data), so a template
+ * menu icon is kept as an 8-bit palette PNG whose pixel index *is* the
+ * alpha: tRNS maps index i to alpha i and PLTE holds the tint 256 times.
+ * Re-tinting rewrites PLTE and its CRC, nothing else. The image data is
+ * stored uncompressed, which keeps the encoder tiny for menu-sized icons. */
+
+#define PNG_PLTE_LEN      (256 * 3)
+#define DEFLATE_BLOCK_MAX 65535
+
+static uint32_t        g_crc_table[256];
+static pthread_once_t  g_crc_once = PTHREAD_ONCE_INIT;
+
+static void init_crc_table(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        g_crc_table[n] = c;
+    }
+}
+
+static uint32_t png_crc(const uint8_t *p, size_t n) {
+    pthread_once(&g_crc_once, init_crc_table);
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; i++) c = g_crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* Writes length, type, payload (already at out + 8) and CRC; returns the chunk size. */
+static size_t png_finish_chunk(uint8_t *out, const char *type, uint32_t len) {
+    put_be32(out, len);
+    memcpy(out + 4, type, 4);
+    put_be32(out + 8 + len, png_crc(out + 4, (size_t)len + 4));
+    return (size_t)len + 12;
+}
+
+static void tint_mask_png(uint8_t *png, size_t plte_off, uint8_t v) {
+    memset(png + plte_off, v, PNG_PLTE_LEN);
+    put_be32(png + plte_off + PNG_PLTE_LEN, png_crc(png + plte_off - 4, PNG_PLTE_LEN + 4));
+}
+
+/* Decode any PNG/JPG and re-encode its alpha as a template PNG. */
+static uint8_t *encode_mask_png(const uint8_t *data, size_t len,
+                                size_t *out_len, size_t *plte_off) {
+    int w, h, channels;
+    uint8_t *rgba = stbi_load_from_memory(data, (int)len, &w, &h, &channels, 4);
+    if (!rgba) return NULL;
+
+    size_t raw_len = (size_t)h * ((size_t)w + 1); /* filter byte + indices per row */
+    size_t blocks = raw_len ? (raw_len + DEFLATE_BLOCK_MAX - 1) / DEFLATE_BLOCK_MAX : 1;
+    size_t zlib_len = 2 + raw_len + blocks * 5 + 4;
+    size_t total = 8 + (12 + 13) + (12 + PNG_PLTE_LEN) + (12 + 256) + (12 + zlib_len) + 12;
+    uint8_t *png = malloc(total);
+    if (!png) { stbi_image_free(rgba); return NULL; }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t *p = png;
+    memcpy(p, signature, 8);
+    p += 8;
+
+    uint8_t *d = p + 8;
+    put_be32(d, (uint32_t)w);
+    put_be32(d + 4, (uint32_t)h);
+    d[8] = 8;  /* bit depth */
+    d[9] = 3;  /* indexed color */
+    d[10] = d[11] = d[12] = 0;
+    p += png_finish_chunk(p, "IHDR", 13);
+
+    *plte_off = (size_t)(p + 8 - png);
+    memset(p + 8, 0, PNG_PLTE_LEN);
+    p += png_finish_chunk(p, "PLTE", PNG_PLTE_LEN);
+
+    for (int i = 0; i < 256; i++) p[8 + i] = (uint8_t)i;
+    p += png_finish_chunk(p, "tRNS", 256);
+
+    d = p + 8;
+    *d++ = 0x78; /* zlib header: deflate, 32K window, no preset dictionary */
+    *d++ = 0x01;
+    uint32_t a1 = 1, a2 = 0; /* Adler-32 of the raw scanlines */
+    size_t row = 0, col = 0, left = raw_len;
+    do {
+        size_t n = left < DEFLATE_BLOCK_MAX ? left : DEFLATE_BLOCK_MAX;
+        left -= n;
+        *d++ = left == 0 ? 1 : 0; /* BFINAL, BTYPE=00 (stored) */
+        d[0] = (uint8_t)n;
+        d[1] = (uint8_t)(n >> 8);
+        d[2] = (uint8_t)~n;
+        d[3] = (uint8_t)(~n >> 8);
+        d += 4;
+        for (size_t k = 0; k < n; k++) {
+            uint8_t b;
+            if (col == 0) {
+                b = 0; /* filter: none */
+            } else {
+                b = rgba[(row * (size_t)w + col - 1) * 4 + 3];
+            }
+            if (++col > (size_t)w) { col = 0; row++; }
+            *d++ = b;
+            a1 = (a1 + b) % 65521;
+            a2 = (a2 + a1) % 65521;
+        }
+    } while (left > 0);
+    put_be32(d, (a2 << 16) | a1);
+    p += png_finish_chunk(p, "IDAT", (uint32_t)zlib_len);
+
+    p += png_finish_chunk(p, "IEND", 0);
+    stbi_image_free(rgba);
+
+    *out_len = (size_t)(p - png);
+    return png;
+}
+
 /* ========================================================================== */
 /*  Menu item helpers                                                         */
 /* ========================================================================== */
 
 static menu_item *find_item(sni_tray *tray, int32_t id) {
-    for (int i = 0; i < tray->item_count; i++) {
-        if (tray->items[i].id == id) return &tray->items[i];
-    }
-    return NULL;
+    if (id <= 0 || (uint32_t)id >= tray->index_capacity) return NULL;
+    int32_t i = tray->item_index[id];
+    if (i < 0 || i >= tray->item_count || tray->items[i].id != id) return NULL;
+    return &tray->items[i];
+}
+
+/* Point item_index at positions [from, to) of tray->items after a shift */
+static void reindex_items(sni_tray *tray, int from, int to) {
+    for (int i = from; i < to; i++) tray->item_index[tray->items[i].id] = i;
+}
+
+static int ensure_item_index(sni_tray *tray, uint32_t id) {
+    if (id < tray->index_capacity) return 1;
+    uint32_t cap = tray->index_capacity ? tray->index_capacity : 32;
+    while (cap <= id) cap *= 2;
+    int32_t *index = realloc(tray->item_index, (size_t)cap * sizeof(int32_t));
+    if (!index) return 0;
+    memset(index + tray->index_capacity, 0xff, (size_t)(cap - tray->index_capacity) * sizeof(int32_t));
+    tray->item_index = index;
+    tray->index_capacity = cap;
+    return 1;
 }
 
 static menu_item *alloc_item(sni_tray *tray) {
@@ -279,18 +649,27 @@ static menu_item *alloc_item(sni_tray *tray) {
     return item;
 }
 
+static void free_item_fields(menu_item *item) {
+    free(item->label);
+    free(item->tooltip);
+    free(item->icon_data);
+    free(item->shortcut_key);
+    free(item->children);
+}
+
 static void free_menu_items(sni_tray *tray) {
-    for (int i = 0; i < tray->item_count; i++) {
-        free(tray->items[i].label);
-        free(tray->items[i].tooltip);
-        free(tray->items[i].icon_data);
-        free(tray->items[i].shortcut_key);
-        free(tray->items[i].children);
-    }
+    for (int i = 0; i < tray->item_count; i++) free_item_fields(&tray->items[i]);
     free(tray->items);
     tray->items = NULL;
     tray->item_count = 0;
     tray->item_capacity = 0;
+    free(tray->item_index);
+    tray->item_index = NULL;
+    tray->index_capacity = 0;
+    free(tray->group_selected);
+    tray->group_selected = NULL;
+    tray->group_capacity = 0;
+    tray->pending_prop_count = 0;
 }
 
 /* ========================================================================== */
@@ -308,22 +687,9 @@ static const char *no_menu_path(desktop_env de) {
 /*  D-Bus: emit signals                                                       */
 /* ========================================================================== */
 
-static void emit_new_icon(sni_tray *tray) {
-    if (!tray->bus) return;
-    sd_bus_emit_signal(tray->bus, SNI_PATH, SNI_IFACE, "NewIcon", "");
-}
-
-static void emit_new_title(sni_tray *tray) {
-    if (!tray->bus) return;
-    sd_bus_emit_signal(tray->bus, SNI_PATH, SNI_IFACE, "NewTitle", "");
-}
-
 static void emit_layout_updated(sni_tray *tray) {
-    if (!tray->bus) return;
     tray->menu_version++;
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    tray->last_layout_updated_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    tray->last_layout_updated_ms = now_ms();
     sd_bus_emit_signal(tray->bus, MENU_PATH, MENU_IFACE, "LayoutUpdated",
                        "ui", tray->menu_version, (int32_t)0);
     /* Also emit properties changed for Version */
@@ -331,9 +697,101 @@ static void emit_layout_updated(sni_tray *tray) {
                                    "Version", NULL);
 }
 
-static void emit_sni_properties_changed(sni_tray *tray, const char *prop) {
-    if (!tray->bus) return;
-    sd_bus_emit_properties_changed(tray->bus, SNI_PATH, SNI_IFACE, prop, NULL);
+/* Wake the event loop. The pipe is non-blocking: if it is already full the
+ * loop is awake anyway. */
+static void wake_loop(sni_tray *tray) {
+    char c = 1;
+    if (write(tray->wake_pipe[1], &c, 1) < 0) { /* ignore */ }
+}
+
+/* Record a pending notification. Caller holds tray->lock. */
+static void mark_dirty(sni_tray *tray, uint32_t bits) {
+    uint32_t was = tray->dirty;
+    tray->dirty |= bits;
+    if (!was) wake_loop(tray);
+}
+
+/* Queue a toggle-state update for one item. Past MAX_PENDING_PROPS the
+ * whole layout is re-sent instead. Caller holds tray->lock. */
+static void mark_item_props(sni_tray *tray, int32_t id) {
+    for (int i = 0; i < tray->pending_prop_count; i++)
+        if (tray->pending_prop_ids[i] == id) return;
+    if (tray->pending_prop_count == MAX_PENDING_PROPS) {
+        mark_dirty(tray, DIRTY_LAYOUT);
+        return;
+    }
+    tray->pending_prop_ids[tray->pending_prop_count++] = id;
+    mark_dirty(tray, DIRTY_ITEMS);
+}
+
+/* ItemsPropertiesUpdated carrying toggle-state for the queued items only. */
+static void emit_items_properties(sni_tray *tray) {
+    sd_bus_message *m = NULL;
+    if (sd_bus_message_new_signal(tray->bus, &m, MENU_PATH, MENU_IFACE,
+                                  "ItemsPropertiesUpdated") < 0)
+        return;
+    int r = sd_bus_message_open_container(m, 'a', "(ia{sv})");
+    for (int i = 0; r >= 0 && i < tray->pending_prop_count; i++) {
+        menu_item *item = find_item(tray, tray->pending_prop_ids[i]);
+        if (!item) continue;
+        r = sd_bus_message_append(m, "(ia{sv})", item->id, 1,
+                                  "toggle-state", "i", item->checked ? 1 : 0);
+    }
+    if (r >= 0) r = sd_bus_message_close_container(m);
+    if (r >= 0) r = sd_bus_message_append(m, "a(ias)", 0);
+    if (r >= 0) sd_bus_send(tray->bus, m, NULL);
+    sd_bus_message_unref(m);
+}
+
+static const char *status_name(int status) {
+    switch (status) {
+    case SNI_STATUS_PASSIVE:         return "Passive";
+    case SNI_STATUS_NEEDS_ATTENTION: return "NeedsAttention";
+    default:                         return "Active";
+    }
+}
+
+/* Emit everything that changed since the last flush, one signal per kind.
+ * Loop thread only, with tray->lock held. */
+static void flush_dirty(sni_tray *tray) {
+    uint32_t d = tray->dirty;
+    if (!tray->bus || !d) return;
+    tray->dirty = 0;
+    tray->last_flush_ms = now_ms();
+
+    if (d & DIRTY_ICON)
+        sd_bus_emit_signal(tray->bus, SNI_PATH, SNI_IFACE, "NewIcon", "");
+    if (d & DIRTY_TITLE)
+        sd_bus_emit_signal(tray->bus, SNI_PATH, SNI_IFACE, "NewTitle", "");
+    if (d & DIRTY_ATTENTION)
+        sd_bus_emit_signal(tray->bus, SNI_PATH, SNI_IFACE, "NewAttentionIcon", "");
+    if (d & DIRTY_STATUS)
+        sd_bus_emit_signal(tray->bus, SNI_PATH, SNI_IFACE, "NewStatus", "s",
+                           status_name(tray->status));
+
+    /* Batch changed SNI properties into a single PropertiesChanged */
+    char *props[3];
+    int n = 0;
+    if (d & (DIRTY_ICON | DIRTY_TOOLTIP)) props[n++] = "ToolTip";
+    if (d & DIRTY_MENU) props[n++] = "Menu";
+    props[n] = NULL;
+    if (n > 0)
+        sd_bus_emit_properties_changed_strv(tray->bus, SNI_PATH, SNI_IFACE, props);
+
+    /* A relayout already carries every toggle-state */
+    if (d & DIRTY_LAYOUT)
+        emit_layout_updated(tray);
+    else if (d & DIRTY_ITEMS)
+        emit_items_properties(tray);
+    tray->pending_prop_count = 0;
+}
+
+/* Milliseconds until the next flush is allowed, or -1 if nothing is pending.
+ * Nothing is due while no host is there to listen, or inside an update. */
+static int64_t flush_delay_ms(sni_tray *tray) {
+    if (!tray->dirty || tray->host_present == 0 || tray->update_depth > 0) return -1;
+    int64_t due = tray->last_flush_ms + tray->flush_interval_ms - now_ms();
+    return due > 0 ? due : 0;
 }
 
 /* ========================================================================== */
@@ -409,7 +867,7 @@ static int sni_get_property(sd_bus *bus, const char *path, const char *interface
     if (strcmp(property, "Title") == 0)
         return sd_bus_message_append(reply, "s", tray->title ? tray->title : "");
     if (strcmp(property, "Status") == 0)
-        return sd_bus_message_append(reply, "s", "Active");
+        return sd_bus_message_append(reply, "s", status_name(tray->status));
     if (strcmp(property, "WindowId") == 0)
         return sd_bus_message_append(reply, "i", 0);
     if (strcmp(property, "IconThemePath") == 0)
@@ -429,7 +887,7 @@ static int sni_get_property(sd_bus *bus, const char *path, const char *interface
     if (strcmp(property, "AttentionIconName") == 0)
         return sd_bus_message_append(reply, "s", "");
     if (strcmp(property, "AttentionIconPixmap") == 0)
-        return append_empty_pixmap_list(reply);
+        return append_pixmap_list(reply, &tray->attention_pixmaps);
     if (strcmp(property, "AttentionMovieName") == 0)
         return sd_bus_message_append(reply, "s", "");
     if (strcmp(property, "ToolTip") == 0)
@@ -442,6 +900,16 @@ static int sni_get_property(sd_bus *bus, const char *path, const char *interface
 /*  D-Bus: SNI methods                                                        */
 /* ========================================================================== */
 
+/* Method handlers run on the loop thread with tray->lock held. Callbacks go
+ * into the JVM, which may call straight back into the setters (from this or
+ * another thread), so the lock is released around them. */
+#define INVOKE_UNLOCKED(tray, call)              \
+    do {                                         \
+        pthread_mutex_unlock(&(tray)->lock);     \
+        call;                                    \
+        pthread_mutex_lock(&(tray)->lock);       \
+    } while (0)
+
 static int sni_activate(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
     (void)error;
     sni_tray *tray = userdata;
@@ -453,21 +921,42 @@ static int sni_activate(sd_bus_message *msg, void *userdata, sd_bus_error *error
     tray->last_click_y = y;
     pthread_mutex_unlock(&tray->click_lock);
 
-    /* Double-click detection */
+    /* Classify on the loop's monotonic clock: the second Activate within
+     * DCLICK_INTERVAL is a double click and replaces the single one. */
     int64_t now = now_ms();
-    if (tray->last_activate_ms > 0 && (now - tray->last_activate_ms) < DCLICK_INTERVAL) {
-        tray->last_activate_ms = 0;
-        /* Double click — still invoke on_click */
-    } else {
-        tray->last_activate_ms = now;
+    int dclick = tray->last_activate_ms > 0 && (now - tray->last_activate_ms) < DCLICK_INTERVAL;
+    tray->last_activate_ms = dclick ? 0 : now;
+
+    if (dclick) {
+        tray->pending_click_due_ms = 0; /* a deferred single click is superseded */
+        if (tray->on_dclick)
+            INVOKE_UNLOCKED(tray, tray->on_dclick(x, y, tray->on_dclick_data));
+    } else if (tray->defer_single_click) {
+        tray->pending_click_x = x;
+        tray->pending_click_y = y;
+        tray->pending_click_due_ms = now + DCLICK_INTERVAL;
+    } else if (tray->on_click) {
+        INVOKE_UNLOCKED(tray, tray->on_click(x, y, tray->on_click_data));
     }
 
-    if (tray->on_click)
-        tray->on_click(x, y, tray->on_click_data);
-
     return sd_bus_reply_method_return(msg, "");
 }
 
+/* Milliseconds until a deferred single click is due, or -1 if none. */
+static int64_t pending_click_delay_ms(sni_tray *tray) {
+    if (tray->pending_click_due_ms == 0) return -1;
+    int64_t due = tray->pending_click_due_ms - now_ms();
+    return due > 0 ? due : 0;
+}
+
+/* No second click came: deliver the held single click. Caller holds tray->lock. */
+static void deliver_pending_click(sni_tray *tray) {
+    tray->pending_click_due_ms = 0;
+    if (tray->on_click)
+        INVOKE_UNLOCKED(tray, tray->on_click(tray->pending_click_x, tray->pending_click_y,
+                                             tray->on_click_data));
+}
+
 static int sni_context_menu(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
     (void)error;
     sni_tray *tray = userdata;
@@ -480,7 +969,7 @@ static int sni_context_menu(sd_bus_message *msg, void *userdata, sd_bus_error *e
     pthread_mutex_unlock(&tray->click_lock);
 
     if (tray->on_rclick)
-        tray->on_rclick(x, y, tray->on_rclick_data);
+        INVOKE_UNLOCKED(tray, tray->on_rclick(x, y, tray->on_rclick_data));
 
     return sd_bus_reply_method_return(msg, "");
 }
@@ -496,14 +985,50 @@ static int sni_secondary_activate(sd_bus_message *msg, void *userdata, sd_bus_er
     tray->last_click_y = y;
     pthread_mutex_unlock(&tray->click_lock);
 
+    /* SecondaryActivate is what hosts send for a middle click */
+    if (tray->on_middle_click)
+        INVOKE_UNLOCKED(tray, tray->on_middle_click(x, y, tray->on_middle_click_data));
+
     return sd_bus_reply_method_return(msg, "");
 }
 
 static int sni_scroll(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
-    (void)error; (void)userdata;
+    (void)error;
+    sni_tray *tray = userdata;
+    int32_t delta = 0;
+    const char *orientation = NULL;
+    if (sd_bus_message_read(msg, "is", &delta, &orientation) >= 0 && delta != 0 && tray->on_scroll) {
+        int axis = (orientation && strcasecmp(orientation, "horizontal") == 0)
+                       ? SNI_SCROLL_HORIZONTAL : SNI_SCROLL_VERTICAL;
+        int64_t sum = (int64_t)tray->scroll_delta[axis] + delta;
+        if (sum > INT32_MAX) sum = INT32_MAX;
+        if (sum < INT32_MIN) sum = INT32_MIN;
+        tray->scroll_delta[axis] = (int32_t)sum;
+        if (tray->scroll_due_ms == 0) tray->scroll_due_ms = now_ms() + tray->flush_interval_ms;
+    }
     return sd_bus_reply_method_return(msg, "");
 }
 
+/* Milliseconds until the pending scroll is due, or -1 if there is none. */
+static int64_t scroll_delay_ms(sni_tray *tray) {
+    if (tray->scroll_due_ms == 0) return -1;
+    int64_t due = tray->scroll_due_ms - now_ms();
+    return due > 0 ? due : 0;
+}
+
+/* Deliver the summed deltas, one upcall per axis that moved. Caller holds tray->lock. */
+static void deliver_scroll(sni_tray *tray) {
+    int32_t delta[2] = {tray->scroll_delta[0], tray->scroll_delta[1]};
+    tray->scroll_delta[0] = tray->scroll_delta[1] = 0;
+    tray->scroll_due_ms = 0;
+    sni_scroll_cb cb = tray->on_scroll;
+    void *data = tray->on_scroll_data;
+    if (!cb) return;
+    for (int axis = 0; axis < 2; axis++) {
+        if (delta[axis] != 0) INVOKE_UNLOCKED(tray, cb(delta[axis], axis, data));
+    }
+}
+
 /* ========================================================================== */
 /*  D-Bus: SNI vtable                                                         */
 /* ========================================================================== */
@@ -604,7 +1129,7 @@ static int append_menu_layout(sd_bus_message *reply, sni_tray *tray,
 
                 if (item->checkable) {
                     r = sd_bus_message_append(reply, "{sv}", "toggle-type",
-                                              "s", "checkmark");
+                                              "s", item->radio_group ? "radio" : "checkmark");
                     if (r < 0) return r;
                     r = sd_bus_message_append(reply, "{sv}", "toggle-state",
                                               "i", item->checked ? 1 : 0);
@@ -778,7 +1303,8 @@ static int menu_get_group_properties(sd_bus_message *msg, void *userdata, sd_bus
                 sd_bus_message_append(reply, "{sv}", "label", "s", item->label ? item->label : "");
                 sd_bus_message_append(reply, "{sv}", "enabled", "b", !item->disabled);
                 if (item->checkable) {
-                    sd_bus_message_append(reply, "{sv}", "toggle-type", "s", "checkmark");
+                    sd_bus_message_append(reply, "{sv}", "toggle-type", "s",
+                                          item->radio_group ? "radio" : "checkmark");
                     sd_bus_message_append(reply, "{sv}", "toggle-state", "i", item->checked ? 1 : 0);
                 }
                 if (item->shortcut_key) {
@@ -853,7 +1379,7 @@ static int menu_event(sd_bus_message *msg, void *userdata, sd_bus_error *error)
     sd_bus_message_skip(msg, "vu");
 
     if (strcmp(event_id, "clicked") == 0 && tray->on_menu_item) {
-        tray->on_menu_item((uint32_t)id, tray->on_menu_item_data);
+        INVOKE_UNLOCKED(tray, tray->on_menu_item((uint32_t)id, tray->on_menu_item_data));
     }
 
     return sd_bus_reply_method_return(msg, "");
@@ -874,7 +1400,7 @@ static int menu_event_group(sd_bus_message *msg, void *userdata, sd_bus_error *e
         sd_bus_message_exit_container(msg);
 
         if (strcmp(event_id, "clicked") == 0 && tray->on_menu_item) {
-            tray->on_menu_item((uint32_t)id, tray->on_menu_item_data);
+            INVOKE_UNLOCKED(tray, tray->on_menu_item((uint32_t)id, tray->on_menu_item_data));
         }
     }
     sd_bus_message_exit_container(msg);
@@ -903,7 +1429,7 @@ static int menu_about_to_show(sd_bus_message *msg, void *userdata, sd_bus_error
         /* Only fire on genuine user-initiated opens, not on AboutToShow
            calls triggered by a recent LayoutUpdated from a menu rebuild. */
         if (now_ms - tray->last_layout_updated_ms > 300) {
-            tray->on_menu_opened(tray->on_menu_opened_data);
+            INVOKE_UNLOCKED(tray, tray->on_menu_opened(tray->on_menu_opened_data));
         }
     }
     return sd_bus_reply_method_return(msg, "b", 0);
@@ -987,176 +1513,930 @@ static const sd_bus_vtable menu_vtable[] = {
 };
 
 /* ========================================================================== */
-/*  Public API: Lifecycle                                                     */
+/*  D-Bus: watcher registration and connection management                     */
 /* ========================================================================== */
 
-sni_tray *sni_tray_create(const uint8_t *icon_data, size_t icon_len,
-                           const char *tooltip) {
-    sni_tray *tray = calloc(1, sizeof(sni_tray));
-    if (!tray) return NULL;
+/* Install reply of an asynchronous match. Left alone, sd-bus drops the whole
+ * connection when a match is refused; losing one subscription is milder. */
+static int on_match_installed(sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    (void)userdata; (void)error;
+    const sd_bus_error *e = sd_bus_message_get_error(reply);
+    if (e) fprintf(stderr, "sni: failed to add match: %s\n", e->message ? e->message : e->name);
+    return 0;
+}
 
-    pthread_mutex_init(&tray->click_lock, NULL);
-    tray->next_id = 1;
-    tray->menu_version = 1;
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    tray->last_layout_updated_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-    tray->de = detect_desktop();
-    tray->current_menu_path = no_menu_path(tray->de);
+/* Hosts talk to our unique name, so losing the well-known one is not fatal */
+static int on_name_reply(sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    const sd_bus_error *e = sd_bus_message_get_error(reply);
+    if (e)
+        fprintf(stderr, "sni: failed to request bus name '%s': %s\n",
+                tray->bus_name, e->message ? e->message : e->name);
+    return 0;
+}
 
-    if (tooltip) tray->tooltip_text = strdup(tooltip);
-    if (icon_data && icon_len > 0) {
-        tray->icon_pixmaps = build_pixmaps(icon_data, icon_len);
+static int on_register_reply(sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    tray->register_slot = sd_bus_slot_unref(tray->register_slot);
+
+    const sd_bus_error *e = sd_bus_message_get_error(reply);
+    if (e) {
+        /* Not fatal — some environments don't have a watcher yet; we
+         * register again as soon as one claims its name. */
+        fprintf(stderr, "sni: failed to register with watcher: %s\n",
+                e->message ? e->message : e->name);
+        return 0;
     }
 
-    if (pipe(tray->quit_pipe) < 0) {
-        free(tray->tooltip_text);
-        free(tray);
-        return NULL;
+    tray->stats.registrations++;
+    if (tray->stats.startup_latency_ms < 0)
+        tray->stats.startup_latency_ms = now_ms() - tray->created_ms;
+    if (tray->lost_at_ms > 0) {
+        tray->stats.recoveries++;
+        tray->stats.last_recovery_ms = now_ms() - tray->lost_at_ms;
+        tray->lost_at_ms = 0;
     }
+    return 0;
+}
 
-    return tray;
+/* Fire-and-forget RegisterStatusNotifierItem; the reply lands in
+ * on_register_reply from the event loop. */
+static void register_with_watcher(sni_tray *tray) {
+    tray->register_slot = sd_bus_slot_unref(tray->register_slot);
+    int r = sd_bus_call_method_async(tray->bus, &tray->register_slot,
+                                     WATCHER_BUS, WATCHER_PATH, WATCHER_IFACE,
+                                     "RegisterStatusNotifierItem",
+                                     on_register_reply, tray, "s", SNI_PATH);
+    if (r < 0)
+        fprintf(stderr, "sni: failed to send watcher registration: %s\n", strerror(-r));
 }
 
-int sni_tray_run(sni_tray *tray) {
-    int r;
+/* ========================================================================== */
+/*  D-Bus: StatusNotifierHost presence                                        */
+/* ========================================================================== */
 
-    r = sd_bus_open_user(&tray->bus);
-    if (r < 0) {
-        fprintf(stderr, "sni: failed to connect to session bus: %s\n", strerror(-r));
-        return r;
+/* Caller holds tray->lock. A host showing up gets the whole current state
+ * once; everything collapsed into `dirty` meanwhile goes out with it. */
+static void apply_host_present(sni_tray *tray, int present) {
+    if (present == tray->host_present) return;
+    int was = tray->host_present;
+    tray->host_present = present;
+    if (present && was == 0) mark_dirty(tray, DIRTY_ALL);
+    /* Unknown is not reported; a known state only when it differs from the last one */
+    if (present < 0 || present == tray->host_reported) return;
+    tray->host_reported = present;
+    if (tray->on_host) {
+        sni_host_cb cb = tray->on_host;
+        void *data = tray->on_host_data;
+        INVOKE_UNLOCKED(tray, cb(present, data));
     }
+}
 
-    /* Export SNI interface */
-    r = sd_bus_add_object_vtable(tray->bus, &tray->sni_slot, SNI_PATH,
-                                 SNI_IFACE, sni_vtable, tray);
-    if (r < 0) {
-        fprintf(stderr, "sni: failed to add SNI vtable: %s\n", strerror(-r));
-        return r;
+static int on_host_registered_reply(sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    tray->host_read_slot = sd_bus_slot_unref(tray->host_read_slot);
+    int present;
+    /* Watchers without the property leave the state unknown, i.e. we keep emitting */
+    if (sd_bus_message_is_method_error(reply, NULL) ||
+        sd_bus_message_read(reply, "v", "b", &present) < 0) {
+        apply_host_present(tray, -1);
+        return 0;
     }
+    apply_host_present(tray, present != 0);
+    return 0;
+}
 
-    /* Export DBusMenu interface */
-    r = sd_bus_add_object_vtable(tray->bus, &tray->menu_slot, MENU_PATH,
-                                 MENU_IFACE, menu_vtable, tray);
-    if (r < 0) {
-        fprintf(stderr, "sni: failed to add menu vtable: %s\n", strerror(-r));
-        return r;
-    }
+static void read_host_registered(sni_tray *tray) {
+    tray->host_read_slot = sd_bus_slot_unref(tray->host_read_slot);
+    int r = sd_bus_call_method_async(tray->bus, &tray->host_read_slot,
+                                     WATCHER_BUS, WATCHER_PATH, PROPERTIES_IFACE, "Get",
+                                     on_host_registered_reply, tray, "ss",
+                                     WATCHER_IFACE, "IsStatusNotifierHostRegistered");
+    if (r < 0)
+        fprintf(stderr, "sni: failed to read host registration: %s\n", strerror(-r));
+}
 
-    /* Request bus name */
-    char name[128];
-    snprintf(name, sizeof(name), "org.kde.StatusNotifierItem-%d-1", getpid());
-    tray->bus_name = strdup(name);
+/* StatusNotifierHostRegistered means at least one host */
+static int on_host_registered(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
+    (void)msg; (void)error;
+    apply_host_present(userdata, 1);
+    return 0;
+}
 
-    r = sd_bus_request_name(tray->bus, name, 0);
-    if (r < 0) {
-        fprintf(stderr, "sni: failed to request bus name '%s': %s\n", name, strerror(-r));
-        return r;
-    }
+/* After StatusNotifierHostUnregistered others may remain, so ask again */
+static int on_host_unregistered(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
+    (void)msg; (void)error;
+    read_host_registered(userdata);
+    return 0;
+}
 
-    /* Register with StatusNotifierWatcher */
-    sd_bus_error err = SD_BUS_ERROR_NULL;
-    r = sd_bus_call_method(tray->bus,
-                           WATCHER_BUS, WATCHER_PATH, WATCHER_IFACE,
-                           "RegisterStatusNotifierItem",
-                           &err, NULL, "s", SNI_PATH);
-    if (r < 0) {
-        fprintf(stderr, "sni: failed to register with watcher: %s\n",
-                err.message ? err.message : strerror(-r));
-        sd_bus_error_free(&err);
-        /* Not fatal — some environments don't have a watcher */
-    }
+/* One match per member: the watcher also relays every other tray app's
+ * StatusNotifierItem* signals, which must not wake this loop. */
+static void watch_hosts(sni_tray *tray) {
+    int r = sd_bus_match_signal_async(tray->bus, &tray->host_slot,
+                                      WATCHER_BUS, WATCHER_PATH, WATCHER_IFACE,
+                                      "StatusNotifierHostRegistered", on_host_registered,
+                                      on_match_installed, tray);
+    if (r >= 0)
+        r = sd_bus_match_signal_async(tray->bus, &tray->host_gone_slot,
+                                      WATCHER_BUS, WATCHER_PATH, WATCHER_IFACE,
+                                      "StatusNotifierHostUnregistered", on_host_unregistered,
+                                      on_match_installed, tray);
+    if (r < 0)
+        fprintf(stderr, "sni: failed to watch host registration: %s\n", strerror(-r));
+    read_host_registered(tray);
+}
 
-    tray->running = 1;
+/* plasmashell / the GNOME extension restarting drops every registration:
+ * register again whenever a new watcher owner shows up. */
+static int on_name_owner_changed(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    const char *name, *old_owner, *new_owner;
+    if (sd_bus_message_read(msg, "sss", &name, &old_owner, &new_owner) < 0) return 0;
 
-    /* Event loop: process D-Bus messages until quit is signaled */
-    int bus_fd = sd_bus_get_fd(tray->bus);
-    while (tray->running) {
-        /* Process pending messages first */
-        for (;;) {
-            r = sd_bus_process(tray->bus, NULL);
-            if (r < 0) {
-                fprintf(stderr, "sni: bus process error: %s\n", strerror(-r));
-                tray->running = 0;
-                break;
-            }
-            if (r == 0) break; /* no more to process */
-        }
-        if (!tray->running) break;
+    if (new_owner[0] == '\0') {
+        if (tray->lost_at_ms == 0) tray->lost_at_ms = now_ms();
+        /* No watcher, so no host can see us */
+        apply_host_present(tray, 0);
+    } else {
+        register_with_watcher(tray);
+        /* Unknown until the new watcher answers, which it may never do */
+        apply_host_present(tray, -1);
+        read_host_registered(tray);
+    }
+    return 0;
+}
 
-        /* Wait for bus activity or quit signal */
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(bus_fd, &rfds);
-        FD_SET(tray->quit_pipe[0], &rfds);
-        int maxfd = (bus_fd > tray->quit_pipe[0]) ? bus_fd : tray->quit_pipe[0];
-
-        struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
-        int sel = select(maxfd + 1, &rfds, NULL, NULL, &tv);
-        if (sel < 0 && errno != EINTR) break;
-        if (FD_ISSET(tray->quit_pipe[0], &rfds)) {
-            tray->running = 0;
-        }
+/* ========================================================================== */
+/*  D-Bus: color scheme from the XDG settings portal                          */
+/* ========================================================================== */
+
+/* The value is a "u", wrapped in one variant by SettingChanged/ReadOne and in
+ * two by the deprecated Read(). Unwrap whatever is there. */
+static int read_color_scheme(sd_bus_message *msg, int32_t *out) {
+    char type;
+    const char *contents;
+    int depth = 0, r;
+    while ((r = sd_bus_message_peek_type(msg, &type, &contents)) > 0 && type == 'v') {
+        r = sd_bus_message_enter_container(msg, 'v', contents);
+        if (r < 0) return r;
+        depth++;
     }
+    if (r <= 0) return r < 0 ? r : -EINVAL;
+    uint32_t value;
+    if (type != 'u' || sd_bus_message_read(msg, "u", &value) < 0) return -EINVAL;
+    while (depth-- > 0) sd_bus_message_exit_container(msg);
+    *out = value <= SNI_COLOR_SCHEME_LIGHT ? (int32_t)value : SNI_COLOR_SCHEME_DEFAULT;
+    return 0;
+}
 
-    /* Teardown */
-    sd_bus_release_name(tray->bus, tray->bus_name);
-    sd_bus_slot_unref(tray->sni_slot);
-    sd_bus_slot_unref(tray->menu_slot);
-    tray->sni_slot = NULL;
-    tray->menu_slot = NULL;
-    sd_bus_flush_close_unref(tray->bus);
-    tray->bus = NULL;
+/* Caller holds tray->lock. Only real changes reach the callback. */
+static void apply_color_scheme(sni_tray *tray, int32_t scheme) {
+    if (scheme == tray->color_scheme) return;
+    tray->color_scheme = scheme;
+    if (tray->on_color_scheme) {
+        sni_color_scheme_cb cb = tray->on_color_scheme;
+        void *data = tray->on_color_scheme_data;
+        INVOKE_UNLOCKED(tray, cb(scheme, data));
+    }
+}
 
+static int on_setting_changed(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    const char *ns, *key;
+    int32_t scheme;
+    if (sd_bus_message_read(msg, "ss", &ns, &key) < 0) return 0;
+    if (strcmp(ns, APPEARANCE_NS) != 0 || strcmp(key, "color-scheme") != 0) return 0;
+    if (read_color_scheme(msg, &scheme) == 0) apply_color_scheme(tray, scheme);
     return 0;
 }
 
-void sni_tray_quit(sni_tray *tray) {
-    if (!tray) return;
-    tray->running = 0;
-    /* Wake the select() */
-    char c = 1;
-    if (write(tray->quit_pipe[1], &c, 1) < 0) { /* ignore */ }
+static int on_color_scheme_reply(sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    tray->portal_read_slot = sd_bus_slot_unref(tray->portal_read_slot);
+    int32_t scheme;
+    /* No portal (or no appearance namespace): stay on the DE heuristic */
+    if (sd_bus_message_is_method_error(reply, NULL)) return 0;
+    if (read_color_scheme(reply, &scheme) == 0) apply_color_scheme(tray, scheme);
+    return 0;
 }
 
-void sni_tray_destroy(sni_tray *tray) {
-    if (!tray) return;
-    close(tray->quit_pipe[0]);
-    close(tray->quit_pipe[1]);
-    free(tray->title);
-    free(tray->tooltip_text);
-    free(tray->bus_name);
-    free_pixmap_list(&tray->icon_pixmaps);
-    free_menu_items(tray);
-    pthread_mutex_destroy(&tray->click_lock);
-    free(tray);
+/* Subscribe to color-scheme changes and fetch the current value, both on the
+ * tray's own connection; nothing blocks and nothing polls. */
+static void watch_color_scheme(sni_tray *tray) {
+    int r = sd_bus_match_signal_async(tray->bus, &tray->portal_slot,
+                                      PORTAL_BUS, PORTAL_PATH, PORTAL_SETTINGS, "SettingChanged",
+                                      on_setting_changed, on_match_installed, tray);
+    if (r < 0) {
+        fprintf(stderr, "sni: failed to watch the settings portal: %s\n", strerror(-r));
+        return;
+    }
+    /* Read() rather than ReadOne(): the latter only exists since portal v2 */
+    r = sd_bus_call_method_async(tray->bus, &tray->portal_read_slot,
+                                 PORTAL_BUS, PORTAL_PATH, PORTAL_SETTINGS, "Read",
+                                 on_color_scheme_reply, tray, "ss",
+                                 APPEARANCE_NS, "color-scheme");
+    if (r < 0)
+        fprintf(stderr, "sni: failed to read the color scheme: %s\n", strerror(-r));
 }
 
 /* ========================================================================== */
-/*  Public API: Tray properties                                               */
+/*  D-Bus: org.freedesktop.Notifications client                               */
 /* ========================================================================== */
 
-void sni_tray_set_icon(sni_tray *tray, const uint8_t *icon_data, size_t icon_len) {
-    if (!tray) return;
-    free_pixmap_list(&tray->icon_pixmaps);
-    tray->icon_pixmaps = build_pixmaps(icon_data, icon_len);
-    emit_new_icon(tray);
-    /* Keep tooltip icon consistent */
-    emit_sni_properties_changed(tray, "ToolTip");
+static void free_notify_req(notify_req *req) {
+    free(req->summary);
+    free(req->body);
+    for (int i = 0; i < req->action_count; i++) free(req->actions[i]);
+    memset(req, 0, sizeof(*req));
 }
 
-void sni_tray_set_title(sni_tray *tray, const char *title) {
-    if (!tray) return;
-    free(tray->title);
-    tray->title = title ? strdup(title) : NULL;
-    emit_new_title(tray);
+static notify_track *find_tracked(sni_tray *tray, int (*match)(const notify_track *, uint64_t),
+                                  uint64_t key) {
+    for (int i = 0; i < NOTIFY_TRACKED; i++) {
+        notify_track *t = &tray->notify_tracked[i];
+        if (t->token && match(t, key)) return t;
+    }
+    return NULL;
 }
 
-void sni_tray_set_tooltip(sni_tray *tray, const char *tooltip) {
+static int match_cookie(const notify_track *t, uint64_t cookie) { return t->cookie == cookie; }
+static int match_server_id(const notify_track *t, uint64_t id) { return t->server_id == id; }
+
+/* Route one event to the callback. Closes and failures end the tracking;
+ * actions, the default one included, are followed by NotificationClosed. */
+static void deliver_notification(sni_tray *tray, notify_track *t, int32_t action, int32_t reason) {
+    uint32_t token = t->token;
+    if (reason != SNI_NOTIFY_ACTION) memset(t, 0, sizeof(*t));
+    sni_notification_cb cb = tray->on_notification;
+    void *data = tray->on_notification_data;
+    if (cb) INVOKE_UNLOCKED(tray, cb(token, action, reason, data));
+}
+
+static int on_notify_reply(sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    uint64_t cookie;
+    if (sd_bus_message_get_reply_cookie(reply, &cookie) < 0) return 0;
+    notify_track *t = find_tracked(tray, match_cookie, cookie);
+    if (!t) return 0;
+    uint32_t id;
+    if (sd_bus_message_is_method_error(reply, NULL) || sd_bus_message_read(reply, "u", &id) < 0) {
+        deliver_notification(tray, t, -1, SNI_NOTIFY_FAILED);
+        return 0;
+    }
+    t->server_id = id;
+    t->cookie = 0;
+    return 0;
+}
+
+static int on_notify_action(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    uint32_t id;
+    const char *key;
+    if (sd_bus_message_read(msg, "us", &id, &key) < 0) return 0;
+    notify_track *t = find_tracked(tray, match_server_id, id);
+    /* Keys are the action indices we sent; "default" is a click on the bubble */
+    char *end;
+    long index = strtol(key, &end, 10);
+    int32_t action = (end != key && *end == '\0') ? (int32_t)index : SNI_NOTIFY_DEFAULT_ACTION;
+    if (t) deliver_notification(tray, t, action, SNI_NOTIFY_ACTION);
+    return 0;
+}
+
+static int on_notify_closed(sd_bus_message *msg, void *userdata, sd_bus_error *error) {
+    (void)error;
+    sni_tray *tray = userdata;
+    uint32_t id, reason;
+    if (sd_bus_message_read(msg, "uu", &id, &reason) < 0) return 0;
+    notify_track *t = find_tracked(tray, match_server_id, id);
+    if (t) deliver_notification(tray, t, -1, (int32_t)reason);
+    return 0;
+}
+
+/* Subscribed on the first notification only: most trays never post one. */
+static void watch_notifications(sni_tray *tray) {
+    if (tray->notify_action_slot) return;
+    int r = sd_bus_match_signal_async(tray->bus, &tray->notify_action_slot,
+                                      NOTIFY_BUS, NOTIFY_PATH, NOTIFY_IFACE, "ActionInvoked",
+                                      on_notify_action, on_match_installed, tray);
+    if (r >= 0)
+        r = sd_bus_match_signal_async(tray->bus, &tray->notify_closed_slot,
+                                      NOTIFY_BUS, NOTIFY_PATH, NOTIFY_IFACE, "NotificationClosed",
+                                      on_notify_closed, on_match_installed, tray);
+    if (r < 0)
+        fprintf(stderr, "sni: failed to watch notification signals: %s\n", strerror(-r));
+}
+
+/* "image-data" hint (iiibiiay) from the largest decoded tray icon: the pixels
+ * are already in memory, so no file or icon name has to be resolved. */
+static int append_image_data(sd_bus_message *m, const pixmap *px) {
+    int r = sd_bus_message_open_container(m, 'e', "sv");
+    if (r >= 0) r = sd_bus_message_append(m, "s", "image-data");
+    if (r >= 0) r = sd_bus_message_open_container(m, 'v', "(iiibiiay)");
+    if (r >= 0) r = sd_bus_message_open_container(m, 'r', "iiibiiay");
+    if (r >= 0) r = sd_bus_message_append(m, "iiibii", px->width, px->height,
+                                          px->width * 4, 1, 8, 4);
+    uint8_t *dst = NULL;
+    if (r >= 0) r = sd_bus_message_append_array_space(m, 'y', px->data_len, (void **)&dst);
+    if (r < 0) return r;
+    /* ARGB32 big-endian (SNI) -> RGBA */
+    for (size_t i = 0; i + 3 < px->data_len; i += 4) {
+        dst[i]     = px->data[i + 1];
+        dst[i + 1] = px->data[i + 2];
+        dst[i + 2] = px->data[i + 3];
+        dst[i + 3] = px->data[i];
+    }
+    r = sd_bus_message_close_container(m);
+    if (r >= 0) r = sd_bus_message_close_container(m);
+    if (r >= 0) r = sd_bus_message_close_container(m);
+    return r;
+}
+
+/* Send one queued notification without waiting for the reply. Loop thread,
+ * tray->lock held. */
+static void send_notify(sni_tray *tray, const notify_req *req) {
+    sd_bus_message *m = NULL;
+    int r = sd_bus_message_new_method_call(tray->bus, &m, NOTIFY_BUS, NOTIFY_PATH,
+                                           NOTIFY_IFACE, "Notify");
+    if (r >= 0) r = sd_bus_message_append(m, "susss", tray->title ? tray->title : "", 0u, "",
+                                          req->summary ? req->summary : "",
+                                          req->body ? req->body : "");
+    if (r >= 0) r = sd_bus_message_open_container(m, 'a', "s");
+    for (int i = 0; r >= 0 && i < req->action_count; i++) {
+        char key[12];
+        snprintf(key, sizeof(key), "%d", i);
+        r = sd_bus_message_append(m, "ss", key, req->actions[i]);
+    }
+    if (r >= 0) r = sd_bus_message_close_container(m);
+    if (r >= 0) r = sd_bus_message_open_container(m, 'a', "{sv}");
+    if (r >= 0 && req->with_icon && tray->icon_pixmaps.count > 0)
+        r = append_image_data(m, &tray->icon_pixmaps.entries[tray->icon_pixmaps.count - 1]);
+    if (r >= 0) r = sd_bus_message_close_container(m);
+    if (r >= 0) r = sd_bus_message_append(m, "i", req->timeout_ms);
+    if (r >= 0) r = sd_bus_call_async(tray->bus, NULL, m, on_notify_reply, tray, 0);
+
+    notify_track *t = &tray->notify_tracked[tray->notify_tracked_next];
+    tray->notify_tracked_next = (tray->notify_tracked_next + 1) % NOTIFY_TRACKED;
+    memset(t, 0, sizeof(*t));
+    t->token = req->token;
+    if (r >= 0) r = sd_bus_message_get_cookie(m, &t->cookie);
+    sd_bus_message_unref(m);
+    if (r < 0) {
+        fprintf(stderr, "sni: failed to send notification: %s\n", strerror(-r));
+        deliver_notification(tray, t, -1, SNI_NOTIFY_FAILED);
+    }
+}
+
+/* Top up the token bucket from the elapsed time. */
+static void refill_notify_tokens(sni_tray *tray, int64_t now) {
+    int64_t steps = (now - tray->notify_refill_ms) / tray->notify_interval_ms;
+    if (steps <= 0) return;
+    int64_t tokens = tray->notify_tokens + steps;
+    tray->notify_tokens = tokens > tray->notify_burst ? tray->notify_burst : (int)tokens;
+    tray->notify_refill_ms = tray->notify_tokens == tray->notify_burst
+                                 ? now : tray->notify_refill_ms + steps * tray->notify_interval_ms;
+}
+
+/* Milliseconds until the next queued notification may be sent, or -1. */
+static int64_t notify_delay_ms(sni_tray *tray) {
+    if (tray->notify_count == 0) return -1;
+    int64_t now = now_ms();
+    refill_notify_tokens(tray, now);
+    if (tray->notify_tokens > 0) return 0;
+    int64_t due = tray->notify_refill_ms + tray->notify_interval_ms - now;
+    return due > 0 ? due : 0;
+}
+
+/* Send as many queued notifications as the bucket allows. Loop thread. */
+static void pump_notifications(sni_tray *tray) {
+    watch_notifications(tray);
+    while (tray->notify_count > 0 && tray->notify_tokens > 0) {
+        notify_req req = tray->notify_queue[tray->notify_head];
+        memset(&tray->notify_queue[tray->notify_head], 0, sizeof(notify_req));
+        tray->notify_head = (tray->notify_head + 1) % NOTIFY_QUEUE;
+        tray->notify_count--;
+        tray->notify_tokens--;
+        send_notify(tray, &req);
+        free_notify_req(&req);
+    }
+}
+
+static void bus_disconnect(sni_tray *tray, int graceful) {
+    if (!tray->bus) return;
+    if (graceful && tray->bus_name) sd_bus_release_name(tray->bus, tray->bus_name);
+    tray->register_slot = sd_bus_slot_unref(tray->register_slot);
+    tray->portal_slot = sd_bus_slot_unref(tray->portal_slot);
+    tray->portal_read_slot = sd_bus_slot_unref(tray->portal_read_slot);
+    tray->host_slot = sd_bus_slot_unref(tray->host_slot);
+    tray->host_gone_slot = sd_bus_slot_unref(tray->host_gone_slot);
+    tray->host_read_slot = sd_bus_slot_unref(tray->host_read_slot);
+    tray->notify_action_slot = sd_bus_slot_unref(tray->notify_action_slot);
+    tray->notify_closed_slot = sd_bus_slot_unref(tray->notify_closed_slot);
+    tray->watcher_slot = sd_bus_slot_unref(tray->watcher_slot);
+    tray->sni_slot = sd_bus_slot_unref(tray->sni_slot);
+    tray->menu_slot = sd_bus_slot_unref(tray->menu_slot);
+    tray->bus = graceful ? sd_bus_flush_close_unref(tray->bus)
+                         : sd_bus_close_unref(tray->bus);
+}
+
+/* Open the session bus, export both objects, then queue the name request,
+ * the matches and the watcher registration. Nothing here waits for a reply:
+ * they are all answered later through sd_bus_process(). Loop thread only;
+ * tray->bus and the slots are not touched by any other thread. */
+static int bus_connect(sni_tray *tray) {
+    int r = sd_bus_open_user(&tray->bus);
+    if (r < 0) {
+        fprintf(stderr, "sni: failed to connect to session bus: %s\n", strerror(-r));
+        tray->bus = NULL;
+        return r;
+    }
+
+    /* Export SNI interface */
+    r = sd_bus_add_object_vtable(tray->bus, &tray->sni_slot, SNI_PATH,
+                                 SNI_IFACE, sni_vtable, tray);
+    if (r < 0) {
+        fprintf(stderr, "sni: failed to add SNI vtable: %s\n", strerror(-r));
+        goto fail;
+    }
+
+    /* Export DBusMenu interface */
+    r = sd_bus_add_object_vtable(tray->bus, &tray->menu_slot, MENU_PATH,
+                                 MENU_IFACE, menu_vtable, tray);
+    if (r < 0) {
+        fprintf(stderr, "sni: failed to add menu vtable: %s\n", strerror(-r));
+        goto fail;
+    }
+
+    /* Request bus name */
+    if (!tray->bus_name) {
+        char name[128];
+        snprintf(name, sizeof(name), "org.kde.StatusNotifierItem-%d-1", getpid());
+        tray->bus_name = strdup(name);
+    }
+    r = sd_bus_request_name_async(tray->bus, NULL, tray->bus_name, 0, on_name_reply, tray);
+    if (r < 0) {
+        fprintf(stderr, "sni: failed to request bus name '%s': %s\n",
+                tray->bus_name, strerror(-r));
+        goto fail;
+    }
+
+    /* Follow the watcher across restarts. arg0 keeps the bus daemon from
+     * sending us the ownership changes of every other name. */
+    r = sd_bus_add_match_async(tray->bus, &tray->watcher_slot,
+                               "type='signal',sender='" DBUS_BUS "',path='" DBUS_PATH "',"
+                               "interface='" DBUS_IFACE "',member='NameOwnerChanged',"
+                               "arg0='" WATCHER_BUS "'",
+                               on_name_owner_changed, on_match_installed, tray);
+    if (r < 0)
+        fprintf(stderr, "sni: failed to watch watcher ownership: %s\n", strerror(-r));
+
+    register_with_watcher(tray);
+    watch_hosts(tray);
+    watch_color_scheme(tray);
+    return 0;
+
+fail:
+    bus_disconnect(tray, 0);
+    return r;
+}
+
+/* Poll timeout (ms) for the loop: the earliest of the flush deadline and
+ * sd-bus' own method-call timeouts, capped at one second. */
+static int loop_timeout_ms(sni_tray *tray, int64_t flush_delay) {
+    int64_t timeout = 1000;
+    if (flush_delay >= 0 && flush_delay < timeout) timeout = flush_delay;
+
+    uint64_t until_usec;
+    if (sd_bus_get_timeout(tray->bus, &until_usec) >= 0 && until_usec != UINT64_MAX) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now_usec = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+        int64_t bus_ms = until_usec > now_usec ? (int64_t)((until_usec - now_usec + 999) / 1000) : 0;
+        if (bus_ms < timeout) timeout = bus_ms;
+    }
+    return (int)timeout;
+}
+
+static void drain_wake_pipe(sni_tray *tray) {
+    char buf[64];
+    while (read(tray->wake_pipe[0], buf, sizeof(buf)) > 0) { /* drain */ }
+}
+
+/* ========================================================================== */
+/*  Initial icon decode worker                                                */
+/* ========================================================================== */
+
+static void *decode_icon_worker(void *arg) {
+    sni_tray *tray = arg;
+    pixmap_list pl = build_pixmaps(tray->pending_icon, tray->pending_icon_len);
+
+    pthread_mutex_lock(&tray->lock);
+    free(tray->pending_icon);
+    tray->pending_icon = NULL;
+    tray->pending_icon_len = 0;
+    if (tray->icon_generation == 0) {
+        if (tray->icon_template) tint_pixmap_list(&pl, template_tint(tray));
+        free_pixmap_list(&tray->icon_pixmaps);
+        tray->icon_pixmaps = pl;
+        mark_dirty(tray, DIRTY_ICON);
+    } else {
+        /* sni_tray_set_icon() already replaced it */
+        free_pixmap_list(&pl);
+    }
+    pthread_mutex_unlock(&tray->lock);
+    return NULL;
+}
+
+/* ========================================================================== */
+/*  Public API: Lifecycle                                                     */
+/* ========================================================================== */
+
+sni_tray *sni_tray_create(const uint8_t *icon_data, size_t icon_len,
+                           const char *tooltip) {
+    sni_tray *tray = calloc(1, sizeof(sni_tray));
+    if (!tray) return NULL;
+
+    pthread_mutex_init(&tray->click_lock, NULL);
+    pthread_mutex_init(&tray->lock, NULL);
+    tray->next_id = 1;
+    tray->menu_version = 1;
+    tray->flush_interval_ms = DEFAULT_FLUSH_INTERVAL_MS;
+    tray->stats.last_recovery_ms = -1;
+    tray->stats.startup_latency_ms = -1;
+    tray->created_ms = now_ms();
+    tray->last_layout_updated_ms = now_ms();
+    tray->de = detect_desktop();
+    tray->dark = 1;  /* most panels are dark; Kotlin pushes the real value */
+    tray->status = SNI_STATUS_ACTIVE;
+    tray->host_present = -1;
+    tray->host_reported = -1;
+    tray->notify_next_token = 1;
+    tray->notify_burst = DEFAULT_NOTIFY_BURST;
+    tray->notify_interval_ms = DEFAULT_NOTIFY_INTERVAL_MS;
+    tray->notify_tokens = DEFAULT_NOTIFY_BURST;
+    tray->notify_refill_ms = now_ms();
+    tray->current_menu_path = no_menu_path(tray->de);
+
+    if (tooltip) tray->tooltip_text = strdup(tooltip);
+
+    if (pipe(tray->wake_pipe) < 0) {
+        free(tray->tooltip_text);
+        pthread_mutex_destroy(&tray->lock);
+        pthread_mutex_destroy(&tray->click_lock);
+        free(tray);
+        return NULL;
+    }
+    fcntl(tray->wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(tray->wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    /* Decode the icon off the caller's thread; it is published (and
+     * NewIcon emitted) as soon as it is ready. */
+    if (icon_data && icon_len > 0) {
+        tray->icon_hash = hash_bytes(icon_data, icon_len);
+        tray->pending_icon = malloc(icon_len);
+        if (tray->pending_icon) {
+            memcpy(tray->pending_icon, icon_data, icon_len);
+            tray->pending_icon_len = icon_len;
+            if (pthread_create(&tray->decode_thread, NULL, decode_icon_worker, tray) == 0) {
+                tray->decode_started = 1;
+            } else {
+                /* No worker: decode inline as before */
+                tray->icon_pixmaps = build_pixmaps(tray->pending_icon, icon_len);
+                free(tray->pending_icon);
+                tray->pending_icon = NULL;
+                tray->pending_icon_len = 0;
+            }
+        }
+    }
+
+    return tray;
+}
+
+int sni_tray_run(sni_tray *tray) {
+    int r;
+    tray->running = 1;
+    tray->reconnect_delay_ms = RECONNECT_MIN_MS;
+
+    /* Event loop: process D-Bus messages and flush coalesced signals until
+     * quit is signaled. A lost connection is re-established with backoff. */
+    while (tray->running) {
+        if (!tray->bus) {
+            /* Unlocked: setters only mark state dirty and never touch the bus */
+            int connect_r = bus_connect(tray);
+            pthread_mutex_lock(&tray->lock);
+            if (connect_r >= 0) {
+                if (tray->lost_at_ms > 0) tray->stats.reconnects++;
+                tray->reconnect_delay_ms = RECONNECT_MIN_MS;
+                /* Replay the whole state to whoever is listening */
+                tray->dirty |= DIRTY_ALL;
+            }
+            pthread_mutex_unlock(&tray->lock);
+
+            if (connect_r < 0) {
+                struct pollfd wfd = {.fd = tray->wake_pipe[0], .events = POLLIN};
+                if (poll(&wfd, 1, tray->reconnect_delay_ms) > 0) drain_wake_pipe(tray);
+                tray->reconnect_delay_ms *= 2;
+                if (tray->reconnect_delay_ms > RECONNECT_MAX_MS)
+                    tray->reconnect_delay_ms = RECONNECT_MAX_MS;
+                continue;
+            }
+        }
+
+        pthread_mutex_lock(&tray->lock);
+        /* Process pending messages first */
+        for (;;) {
+            r = sd_bus_process(tray->bus, NULL);
+            if (r < 0) {
+                fprintf(stderr, "sni: bus process error: %s\n", strerror(-r));
+                break;
+            }
+            if (r == 0) break; /* no more to process */
+        }
+        if (r < 0) {
+            /* Connection lost: drop it and reconnect on the next iteration */
+            if (tray->lost_at_ms == 0) tray->lost_at_ms = now_ms();
+            bus_disconnect(tray, 0);
+            pthread_mutex_unlock(&tray->lock);
+            continue;
+        }
+        int64_t delay = flush_delay_ms(tray);
+        if (delay == 0) {
+            flush_dirty(tray);
+            delay = -1;
+        }
+        int64_t scroll_delay = scroll_delay_ms(tray);
+        if (scroll_delay == 0) {
+            deliver_scroll(tray);
+            scroll_delay = -1;
+        }
+        if (scroll_delay >= 0 && (delay < 0 || scroll_delay < delay)) delay = scroll_delay;
+        int64_t click_delay = pending_click_delay_ms(tray);
+        if (click_delay == 0) {
+            deliver_pending_click(tray);
+            click_delay = -1;
+        }
+        if (click_delay >= 0 && (delay < 0 || click_delay < delay)) delay = click_delay;
+        int64_t notify_delay = notify_delay_ms(tray);
+        if (notify_delay == 0) {
+            pump_notifications(tray);
+            notify_delay = notify_delay_ms(tray);
+        }
+        if (notify_delay >= 0 && (delay < 0 || notify_delay < delay)) delay = notify_delay;
+        int timeout = loop_timeout_ms(tray, delay);
+        struct pollfd fds[2] = {
+            {.fd = sd_bus_get_fd(tray->bus), .events = (short)sd_bus_get_events(tray->bus)},
+            {.fd = tray->wake_pipe[0], .events = POLLIN},
+        };
+        pthread_mutex_unlock(&tray->lock);
+        if (!tray->running) break;
+
+        /* Wait for bus activity, a setter, a deadline or quit */
+        int n = poll(fds, 2, timeout);
+        if (n < 0 && errno != EINTR) break;
+        if (n > 0 && (fds[1].revents & POLLIN)) drain_wake_pipe(tray);
+    }
+
+    /* Teardown */
+    pthread_mutex_lock(&tray->lock);
+    bus_disconnect(tray, 1);
+    pthread_mutex_unlock(&tray->lock);
+
+    return 0;
+}
+
+void sni_tray_quit(sni_tray *tray) {
+    if (!tray) return;
+    tray->running = 0;
+    /* Wake the select() */
+    wake_loop(tray);
+}
+
+void sni_tray_destroy(sni_tray *tray) {
     if (!tray) return;
+    if (tray->decode_started) pthread_join(tray->decode_thread, NULL);
+    close(tray->wake_pipe[0]);
+    close(tray->wake_pipe[1]);
+    free(tray->title);
     free(tray->tooltip_text);
-    tray->tooltip_text = tooltip ? strdup(tooltip) : NULL;
-    emit_sni_properties_changed(tray, "ToolTip");
+    free(tray->bus_name);
+    free_pixmap_list(&tray->icon_pixmaps);
+    free_pixmap_list(&tray->attention_pixmaps);
+    free_menu_items(tray);
+    for (int i = 0; i < NOTIFY_QUEUE; i++) free_notify_req(&tray->notify_queue[i]);
+    pthread_mutex_destroy(&tray->click_lock);
+    pthread_mutex_destroy(&tray->lock);
+    free(tray);
+}
+
+/* ========================================================================== */
+/*  Public API: Tray properties                                               */
+/* ========================================================================== */
+
+void sni_tray_set_icon(sni_tray *tray, const uint8_t *icon_data, size_t icon_len) {
+    if (!tray) return;
+    uint64_t hash = (icon_data && icon_len > 0) ? hash_bytes(icon_data, icon_len) : 0;
+    pthread_mutex_lock(&tray->lock);
+    int unchanged = (hash == tray->icon_hash);
+    uint32_t generation = 0;
+    if (unchanged) {
+        tray->stats.suppressed_updates++;
+    } else {
+        /* Claimed now, so that an older decode still running cannot win */
+        tray->icon_hash = hash;
+        generation = ++tray->icon_generation;
+    }
+    pthread_mutex_unlock(&tray->lock);
+    if (unchanged) return;
+
+    /* Decode outside the lock; only the swap is serialized */
+    pixmap_list pl = build_pixmaps(icon_data, icon_len);
+    pthread_mutex_lock(&tray->lock);
+    if (tray->icon_generation != generation) {
+        /* A later set_icon overtook this one: its icon is the current one */
+        pthread_mutex_unlock(&tray->lock);
+        free_pixmap_list(&pl);
+        return;
+    }
+    if (tray->icon_template) tint_pixmap_list(&pl, template_tint(tray));
+    free_pixmap_list(&tray->icon_pixmaps);
+    tray->icon_pixmaps = pl;
+    /* Keep tooltip icon consistent */
+    mark_dirty(tray, DIRTY_ICON);
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_icon_pixmaps(sni_tray *tray, const uint8_t *rgba, size_t len,
+                               const int *sizes, int count) {
+    if (!tray) return;
+    uint64_t hash = (rgba && len > 0) ? hash_bytes(rgba, len) : 0;
+    pthread_mutex_lock(&tray->lock);
+    int unchanged = (hash == tray->icon_hash);
+    uint32_t generation = 0;
+    if (unchanged) {
+        tray->stats.suppressed_updates++;
+    } else {
+        /* Claimed now, so that an older decode still running cannot win */
+        tray->icon_hash = hash;
+        generation = ++tray->icon_generation;
+    }
+    pthread_mutex_unlock(&tray->lock);
+    if (unchanged) return;
+
+    pixmap_list pl = pixmaps_from_rgba(rgba, len, sizes, count);
+    pthread_mutex_lock(&tray->lock);
+    if (tray->icon_generation != generation || (pl.count == 0 && len > 0)) {
+        /* Overtaken by a later icon, or a malformed ladder: keep the current
+         * icon, and do not let the rejected hash suppress a retry */
+        if (tray->icon_generation == generation) tray->icon_hash = 0;
+        pthread_mutex_unlock(&tray->lock);
+        free_pixmap_list(&pl);
+        return;
+    }
+    if (tray->icon_template) tint_pixmap_list(&pl, template_tint(tray));
+    free_pixmap_list(&tray->icon_pixmaps);
+    tray->icon_pixmaps = pl;
+    mark_dirty(tray, DIRTY_ICON);
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_status(sni_tray *tray, int status) {
+    if (!tray) return;
+    if (status != SNI_STATUS_PASSIVE && status != SNI_STATUS_NEEDS_ATTENTION)
+        status = SNI_STATUS_ACTIVE;
+    pthread_mutex_lock(&tray->lock);
+    if (tray->status == status) {
+        tray->stats.suppressed_updates++;
+    } else {
+        tray->status = status;
+        mark_dirty(tray, DIRTY_STATUS);
+    }
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_attention_icon(sni_tray *tray, const uint8_t *icon_data, size_t icon_len) {
+    if (!tray) return;
+    uint64_t hash = (icon_data && icon_len > 0) ? hash_bytes(icon_data, icon_len) : 0;
+    pthread_mutex_lock(&tray->lock);
+    int unchanged = (hash == tray->attention_hash);
+    if (unchanged) tray->stats.suppressed_updates++;
+    pthread_mutex_unlock(&tray->lock);
+    if (unchanged) return;
+
+    /* Decoded now, so switching to NeedsAttention later is a single signal */
+    pixmap_list pl = build_pixmaps(icon_data, icon_len);
+    pthread_mutex_lock(&tray->lock);
+    tray->attention_hash = hash;
+    free_pixmap_list(&tray->attention_pixmaps);
+    tray->attention_pixmaps = pl;
+    mark_dirty(tray, DIRTY_ATTENTION);
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_title(sni_tray *tray, const char *title) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    if (str_equal(tray->title, title)) {
+        tray->stats.suppressed_updates++;
+    } else {
+        free(tray->title);
+        tray->title = title ? strdup(title) : NULL;
+        mark_dirty(tray, DIRTY_TITLE);
+    }
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_tooltip(sni_tray *tray, const char *tooltip) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    if (str_equal(tray->tooltip_text, tooltip)) {
+        tray->stats.suppressed_updates++;
+    } else {
+        free(tray->tooltip_text);
+        tray->tooltip_text = tooltip ? strdup(tooltip) : NULL;
+        mark_dirty(tray, DIRTY_TOOLTIP);
+    }
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_begin_update(sni_tray *tray) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->update_depth++;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_end_update(sni_tray *tray) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    if (tray->update_depth > 0 && --tray->update_depth == 0 && tray->dirty)
+        wake_loop(tray); /* the loop parked with no timeout while held */
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_flush_interval(sni_tray *tray, uint32_t interval_ms) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->flush_interval_ms = interval_ms;
+    /* Re-arm the loop timeout against the new interval */
+    if (tray->dirty) wake_loop(tray);
+    pthread_mutex_unlock(&tray->lock);
+}
+
+/* Re-apply the tint to every template icon. Caller holds tray->lock. */
+static void retint_templates(sni_tray *tray) {
+    uint8_t v = template_tint(tray);
+    if (tray->icon_template && tray->icon_pixmaps.count > 0) {
+        tint_pixmap_list(&tray->icon_pixmaps, v);
+        mark_dirty(tray, DIRTY_ICON);
+    }
+    int items = 0;
+    for (int i = 0; i < tray->item_count; i++) {
+        menu_item *item = &tray->items[i];
+        if (!item->icon_template || !item->icon_data) continue;
+        tint_mask_png(item->icon_data, item->icon_plte_off, v);
+        items = 1;
+    }
+    if (items) mark_dirty(tray, DIRTY_LAYOUT);
+}
+
+void sni_tray_set_icon_template(sni_tray *tray, int enabled) {
+    if (!tray) return;
+    enabled = enabled != 0;
+    pthread_mutex_lock(&tray->lock);
+    if (tray->icon_template == enabled) {
+        tray->stats.suppressed_updates++;
+    } else {
+        tray->icon_template = enabled;
+        if (enabled) {
+            tint_pixmap_list(&tray->icon_pixmaps, template_tint(tray));
+            mark_dirty(tray, DIRTY_ICON);
+        } else {
+            /* The original colors are gone: accept the next icon even if identical */
+            tray->icon_hash = 0;
+        }
+    }
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_dark_mode(sni_tray *tray, int dark) {
+    if (!tray) return;
+    dark = dark != 0;
+    pthread_mutex_lock(&tray->lock);
+    if (tray->dark == dark) {
+        tray->stats.suppressed_updates++;
+    } else {
+        tray->dark = dark;
+        retint_templates(tray);
+    }
+    pthread_mutex_unlock(&tray->lock);
 }
 
 /* ========================================================================== */
@@ -1165,26 +2445,158 @@ void sni_tray_set_tooltip(sni_tray *tray, const char *tooltip) {
 
 void sni_tray_set_click_callback(sni_tray *tray, sni_click_cb cb, void *userdata) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     tray->on_click = cb;
     tray->on_click_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_set_rclick_callback(sni_tray *tray, sni_click_cb cb, void *userdata) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     tray->on_rclick = cb;
     tray->on_rclick_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_set_menu_callback(sni_tray *tray, sni_menu_item_cb cb, void *userdata) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     tray->on_menu_item = cb;
     tray->on_menu_item_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_set_menu_opened_callback(sni_tray *tray, sni_menu_opened_cb cb, void *userdata) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     tray->on_menu_opened = cb;
     tray->on_menu_opened_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_dclick_callback(sni_tray *tray, sni_click_cb cb, void *userdata) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->on_dclick = cb;
+    tray->on_dclick_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_middle_click_callback(sni_tray *tray, sni_click_cb cb, void *userdata) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->on_middle_click = cb;
+    tray->on_middle_click_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_defer_single_click(sni_tray *tray, int enabled) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->defer_single_click = enabled != 0;
+    /* Re-arm the loop timeout in case a click is already held */
+    if (tray->pending_click_due_ms) wake_loop(tray);
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_notification_callback(sni_tray *tray, sni_notification_cb cb, void *userdata) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->on_notification = cb;
+    tray->on_notification_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+uint32_t sni_tray_notify(sni_tray *tray, const char *summary, const char *body,
+                         const char *const *actions, int action_count,
+                         int with_icon, int32_t timeout_ms) {
+    if (!tray) return 0;
+    if (action_count > NOTIFY_MAX_ACTIONS) action_count = NOTIFY_MAX_ACTIONS;
+    notify_req req = {0};
+    req.summary = summary ? strdup(summary) : NULL;
+    req.body = body ? strdup(body) : NULL;
+    for (int i = 0; i < action_count; i++)
+        req.actions[req.action_count++] = strdup(actions[i] ? actions[i] : "");
+    req.with_icon = with_icon;
+    req.timeout_ms = timeout_ms;
+
+    pthread_mutex_lock(&tray->lock);
+    req.token = tray->notify_next_token++;
+    if (tray->notify_next_token == 0) tray->notify_next_token = 1;
+
+    /* Batch bursts: an unsent notification with the same summary is replaced
+     * in place, so a flood of updates shows only the latest text. */
+    notify_req *slot = NULL;
+    for (int i = 0; i < tray->notify_count; i++) {
+        notify_req *q = &tray->notify_queue[(tray->notify_head + i) % NOTIFY_QUEUE];
+        if (str_equal(q->summary, req.summary)) { slot = q; break; }
+    }
+    if (!slot && tray->notify_count == NOTIFY_QUEUE) {
+        /* Full: the oldest unsent one is dropped */
+        free_notify_req(&tray->notify_queue[tray->notify_head]);
+        tray->notify_head = (tray->notify_head + 1) % NOTIFY_QUEUE;
+        tray->notify_count--;
+    }
+    if (slot) {
+        free_notify_req(slot);
+    } else {
+        slot = &tray->notify_queue[(tray->notify_head + tray->notify_count) % NOTIFY_QUEUE];
+        tray->notify_count++;
+    }
+    *slot = req;
+    wake_loop(tray);
+    pthread_mutex_unlock(&tray->lock);
+    return req.token;
+}
+
+void sni_tray_set_notify_rate(sni_tray *tray, int burst, int interval_ms) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->notify_burst = burst > 0 ? burst : 1;
+    tray->notify_interval_ms = interval_ms > 0 ? interval_ms : 1;
+    if (tray->notify_tokens > tray->notify_burst) tray->notify_tokens = tray->notify_burst;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_host_callback(sni_tray *tray, sni_host_cb cb, void *userdata) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->on_host = cb;
+    tray->on_host_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+int sni_tray_get_host_present(sni_tray *tray) {
+    if (!tray) return -1;
+    pthread_mutex_lock(&tray->lock);
+    int present = tray->host_present;
+    pthread_mutex_unlock(&tray->lock);
+    return present;
+}
+
+void sni_tray_set_scroll_callback(sni_tray *tray, sni_scroll_cb cb, void *userdata) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->on_scroll = cb;
+    tray->on_scroll_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_set_color_scheme_callback(sni_tray *tray, sni_color_scheme_cb cb, void *userdata) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    tray->on_color_scheme = cb;
+    tray->on_color_scheme_data = userdata;
+    pthread_mutex_unlock(&tray->lock);
+}
+
+int32_t sni_tray_get_color_scheme(sni_tray *tray) {
+    if (!tray) return SNI_COLOR_SCHEME_DEFAULT;
+    pthread_mutex_lock(&tray->lock);
+    int32_t scheme = tray->color_scheme;
+    pthread_mutex_unlock(&tray->lock);
+    return scheme;
 }
 
 void sni_tray_get_last_click_xy(sni_tray *tray, int32_t *x, int32_t *y) {
@@ -1195,108 +2607,228 @@ void sni_tray_get_last_click_xy(sni_tray *tray, int32_t *x, int32_t *y) {
     pthread_mutex_unlock(&tray->click_lock);
 }
 
+void sni_tray_get_stats(sni_tray *tray, sni_tray_stats *out) {
+    if (!tray || !out) return;
+    pthread_mutex_lock(&tray->lock);
+    *out = tray->stats;
+    pthread_mutex_unlock(&tray->lock);
+}
+
 /* ========================================================================== */
 /*  Public API: Menu management                                               */
 /* ========================================================================== */
 
-/* Update menu path after adding items (GNOME quirk) */
+/* Update menu path after adding items (GNOME quirk). Caller holds tray->lock. */
 static void update_menu_path_after_add(sni_tray *tray) {
     if (tray->de == DE_GNOME && strcmp(tray->current_menu_path, MENU_PATH) != 0) {
         tray->current_menu_path = MENU_PATH;
-        emit_sni_properties_changed(tray, "Menu");
+        mark_dirty(tray, DIRTY_MENU);
     }
     /* KDE: always emit LayoutUpdated so items appear */
-    emit_layout_updated(tray);
+    mark_dirty(tray, DIRTY_LAYOUT);
 }
 
 void sni_tray_reset_menu(sni_tray *tray) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     free_menu_items(tray);
-    tray->menu_version++;
-    emit_layout_updated(tray);
+    /* Restart numbering so ids stay small (1..n) for every rebuild; the
+     * JVM side indexes its action table directly by id. */
+    tray->next_id = 1;
+    mark_dirty(tray, DIRTY_LAYOUT);
 
     /* GNOME: revert to "/" when menu is empty */
     if (tray->de == DE_GNOME) {
         tray->current_menu_path = "/";
-        emit_sni_properties_changed(tray, "Menu");
+        mark_dirty(tray, DIRTY_MENU);
     }
+    pthread_mutex_unlock(&tray->lock);
 }
 
-uint32_t sni_tray_add_menu_item(sni_tray *tray, const char *title,
-                                 const char *tooltip) {
-    if (!tray) return 0;
+/* Append an item under parent_id (0 = root) and return its id, or 0.
+ * Caller holds tray->lock. */
+static uint32_t add_entry_locked(sni_tray *tray, uint32_t parent_id,
+                                 const char *title, const char *tooltip,
+                                 int checkable, int checked, int separator) {
+    if (!ensure_item_index(tray, tray->next_id)) return 0;
     menu_item *item = alloc_item(tray);
     if (!item) return 0;
     item->id = (int32_t)tray->next_id++;
-    item->label = title ? strdup(title) : NULL;
-    item->tooltip = tooltip ? strdup(tooltip) : NULL;
-    item->parent_id = 0;
+    tray->item_index[item->id] = tray->item_count - 1;
+    item->parent_id = (int32_t)parent_id;
+    item->is_separator = separator;
+    if (!separator) {
+        item->label = title ? strdup(title) : NULL;
+        item->tooltip = tooltip ? strdup(tooltip) : NULL;
+        item->checkable = checkable;
+        item->checked = checked;
+    }
     update_menu_path_after_add(tray);
     return (uint32_t)item->id;
 }
 
+static uint32_t add_entry(sni_tray *tray, uint32_t parent_id,
+                          const char *title, const char *tooltip,
+                          int checkable, int checked, int separator) {
+    if (!tray) return 0;
+    pthread_mutex_lock(&tray->lock);
+    uint32_t id = add_entry_locked(tray, parent_id, title, tooltip, checkable, checked, separator);
+    pthread_mutex_unlock(&tray->lock);
+    return id;
+}
+
+/* Siblings are ordered by their position in tray->items, so moving an item
+ * is a single array shift: it is placed right before before_id, or after
+ * everything when before_id is 0 or unknown. Caller holds tray->lock. */
+static int move_entry_locked(sni_tray *tray, int32_t id, int32_t parent_id, int32_t before_id) {
+    menu_item *item = find_item(tray, id);
+    if (!item || id == before_id) return 0;
+    /* An item cannot go below itself or one of its own descendants */
+    for (menu_item *p = parent_id ? find_item(tray, parent_id) : NULL; p;
+         p = p->parent_id ? find_item(tray, p->parent_id) : NULL) {
+        if (p->id == id) return 0;
+    }
+    int from = (int)(item - tray->items);
+    menu_item moved = *item;
+    moved.parent_id = parent_id;
+    memmove(&tray->items[from], &tray->items[from + 1],
+            (size_t)(tray->item_count - from - 1) * sizeof(menu_item));
+    tray->item_count--;
+
+    int to = tray->item_count;
+    menu_item *before = before_id ? find_item(tray, before_id) : NULL;
+    if (before) to = (int)(before - tray->items);
+    memmove(&tray->items[to + 1], &tray->items[to],
+            (size_t)(tray->item_count - to) * sizeof(menu_item));
+    tray->items[to] = moved;
+    tray->item_count++;
+    reindex_items(tray, from < to ? from : to, (from < to ? to : from) + 1);
+    mark_dirty(tray, DIRTY_LAYOUT);
+    return 1;
+}
+
+/* Remove an item and everything below it. Survivors keep their ids and
+ * order. Caller holds tray->lock. */
+static int remove_entry_locked(sni_tray *tray, int32_t id) {
+    if (!find_item(tray, id)) return 0;
+    /* Per position: 0 not yet known, 1 inside the removed subtree, 2 outside */
+    uint8_t *dead = calloc((size_t)tray->item_count, 1);
+    int *path = malloc((size_t)tray->item_count * sizeof(int));
+    if (!dead || !path) {
+        free(dead);
+        free(path);
+        return 0;
+    }
+
+    /* Descendants may sit anywhere in the array, so walk each item's parent
+     * chain up to the first item already classified and settle the whole
+     * chain at once: every item is walked over a single time. */
+    for (int i = 0; i < tray->item_count; i++) {
+        int len = 0;
+        uint8_t verdict = 2;
+        for (int j = i; len < tray->item_count;) {
+            if (dead[j]) {
+                verdict = dead[j];
+                break;
+            }
+            path[len++] = j;
+            if (tray->items[j].id == id) {
+                verdict = 1;
+                break;
+            }
+            menu_item *parent = tray->items[j].parent_id ? find_item(tray, tray->items[j].parent_id) : NULL;
+            if (!parent) break;
+            j = (int)(parent - tray->items);
+        }
+        while (len > 0) dead[path[--len]] = verdict;
+    }
+    free(path);
+
+    int kept = 0;
+    for (int i = 0; i < tray->item_count; i++) {
+        menu_item *item = &tray->items[i];
+        if (dead[i] != 1) {
+            if (kept != i) tray->items[kept] = *item;
+            kept++;
+            continue;
+        }
+        if (item->radio_group && item->radio_group < tray->group_capacity &&
+            tray->group_selected[item->radio_group] == item->id)
+            tray->group_selected[item->radio_group] = 0;
+        for (int j = 0; j < tray->pending_prop_count; j++) {
+            if (tray->pending_prop_ids[j] != item->id) continue;
+            tray->pending_prop_ids[j] = tray->pending_prop_ids[--tray->pending_prop_count];
+            j--;
+        }
+        tray->item_index[item->id] = -1;
+        free_item_fields(item);
+    }
+    tray->item_count = kept;
+    reindex_items(tray, 0, kept);
+    free(dead);
+
+    if (kept == 0 && tray->de == DE_GNOME) {
+        tray->current_menu_path = "/";
+        mark_dirty(tray, DIRTY_MENU);
+    }
+    mark_dirty(tray, DIRTY_LAYOUT);
+    return 1;
+}
+
+uint32_t sni_tray_add_menu_item(sni_tray *tray, const char *title,
+                                 const char *tooltip) {
+    return add_entry(tray, 0, title, tooltip, 0, 0, 0);
+}
+
 uint32_t sni_tray_add_menu_item_checkbox(sni_tray *tray, const char *title,
                                           const char *tooltip, int checked) {
-    if (!tray) return 0;
-    menu_item *item = alloc_item(tray);
-    if (!item) return 0;
-    item->id = (int32_t)tray->next_id++;
-    item->label = title ? strdup(title) : NULL;
-    item->tooltip = tooltip ? strdup(tooltip) : NULL;
-    item->parent_id = 0;
-    item->checkable = 1;
-    item->checked = checked;
-    update_menu_path_after_add(tray);
-    return (uint32_t)item->id;
+    return add_entry(tray, 0, title, tooltip, 1, checked, 0);
 }
 
 void sni_tray_add_separator(sni_tray *tray) {
-    if (!tray) return;
-    menu_item *item = alloc_item(tray);
-    if (!item) return;
-    item->id = (int32_t)tray->next_id++;
-    item->is_separator = 1;
-    item->parent_id = 0;
-    update_menu_path_after_add(tray);
+    add_entry(tray, 0, NULL, NULL, 0, 0, 1);
 }
 
 uint32_t sni_tray_add_sub_menu_item(sni_tray *tray, uint32_t parent_id,
                                      const char *title, const char *tooltip) {
-    if (!tray) return 0;
-    menu_item *item = alloc_item(tray);
-    if (!item) return 0;
-    item->id = (int32_t)tray->next_id++;
-    item->label = title ? strdup(title) : NULL;
-    item->tooltip = tooltip ? strdup(tooltip) : NULL;
-    item->parent_id = (int32_t)parent_id;
-    update_menu_path_after_add(tray);
-    return (uint32_t)item->id;
+    return add_entry(tray, parent_id, title, tooltip, 0, 0, 0);
 }
 
 uint32_t sni_tray_add_sub_menu_item_checkbox(sni_tray *tray, uint32_t parent_id,
                                               const char *title, const char *tooltip,
                                               int checked) {
-    if (!tray) return 0;
-    menu_item *item = alloc_item(tray);
-    if (!item) return 0;
-    item->id = (int32_t)tray->next_id++;
-    item->label = title ? strdup(title) : NULL;
-    item->tooltip = tooltip ? strdup(tooltip) : NULL;
-    item->parent_id = (int32_t)parent_id;
-    item->checkable = 1;
-    item->checked = checked;
-    update_menu_path_after_add(tray);
-    return (uint32_t)item->id;
+    return add_entry(tray, parent_id, title, tooltip, 1, checked, 0);
 }
 
 void sni_tray_add_sub_separator(sni_tray *tray, uint32_t parent_id) {
-    if (!tray) return;
-    menu_item *item = alloc_item(tray);
-    if (!item) return;
-    item->id = (int32_t)tray->next_id++;
-    item->is_separator = 1;
-    item->parent_id = (int32_t)parent_id;
-    update_menu_path_after_add(tray);
+    add_entry(tray, parent_id, NULL, NULL, 0, 0, 1);
+}
+
+uint32_t sni_tray_insert_menu_item(sni_tray *tray, uint32_t parent_id, uint32_t before_id,
+                                   const char *title, int checkable, int checked,
+                                   int separator) {
+    if (!tray) return 0;
+    pthread_mutex_lock(&tray->lock);
+    uint32_t id = add_entry_locked(tray, parent_id, title, NULL, checkable, checked, separator);
+    if (id && before_id) move_entry_locked(tray, (int32_t)id, (int32_t)parent_id, (int32_t)before_id);
+    pthread_mutex_unlock(&tray->lock);
+    return id;
+}
+
+int sni_tray_move_menu_item(sni_tray *tray, uint32_t id, uint32_t parent_id, uint32_t before_id) {
+    if (!tray) return 0;
+    pthread_mutex_lock(&tray->lock);
+    int ok = move_entry_locked(tray, (int32_t)id, (int32_t)parent_id, (int32_t)before_id);
+    pthread_mutex_unlock(&tray->lock);
+    return ok;
+}
+
+int sni_tray_remove_menu_item(sni_tray *tray, uint32_t id) {
+    if (!tray) return 0;
+    pthread_mutex_lock(&tray->lock);
+    int ok = remove_entry_locked(tray, (int32_t)id);
+    pthread_mutex_unlock(&tray->lock);
+    return ok;
 }
 
 /* ========================================================================== */
@@ -1305,79 +2837,240 @@ void sni_tray_add_sub_separator(sni_tray *tray, uint32_t parent_id) {
 
 int sni_tray_item_set_title(sni_tray *tray, uint32_t id, const char *title) {
     if (!tray) return 0;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (!item) return 0;
-    free(item->label);
-    item->label = title ? strdup(title) : NULL;
-    emit_layout_updated(tray);
-    return 1;
+    if (item && str_equal(item->label, title)) {
+        tray->stats.suppressed_updates++;
+    } else if (item) {
+        free(item->label);
+        item->label = title ? strdup(title) : NULL;
+        mark_dirty(tray, DIRTY_LAYOUT);
+    }
+    pthread_mutex_unlock(&tray->lock);
+    return item != NULL;
+}
+
+/* Apply a boolean item flag; unchanged values are counted and dropped.
+ * Caller holds tray->lock. */
+static void update_item_flag(sni_tray *tray, int *field, int value) {
+    if (*field == value) {
+        tray->stats.suppressed_updates++;
+        return;
+    }
+    *field = value;
+    mark_dirty(tray, DIRTY_LAYOUT);
 }
 
 void sni_tray_item_enable(sni_tray *tray, uint32_t id) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (item) { item->disabled = 0; emit_layout_updated(tray); }
+    if (item) update_item_flag(tray, &item->disabled, 0);
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_item_disable(sni_tray *tray, uint32_t id) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (item) { item->disabled = 1; emit_layout_updated(tray); }
+    if (item) update_item_flag(tray, &item->disabled, 1);
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_item_show(sni_tray *tray, uint32_t id) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (item) { item->visible = 1; emit_layout_updated(tray); }
+    if (item) update_item_flag(tray, &item->visible, 1);
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_item_hide(sni_tray *tray, uint32_t id) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (item) { item->visible = 0; emit_layout_updated(tray); }
+    if (item) update_item_flag(tray, &item->visible, 0);
+    pthread_mutex_unlock(&tray->lock);
 }
 
+static void select_in_group(sni_tray *tray, menu_item *item);
+
+/* Radio members keep group_selected[] in step and go out as toggle-state
+ * updates; checkmarks are a plain flag. */
 void sni_tray_item_check(sni_tray *tray, uint32_t id) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (item) { item->checked = 1; emit_layout_updated(tray); }
+    if (item && item->radio_group && item->radio_group < tray->group_capacity)
+        select_in_group(tray, item);
+    else if (item)
+        update_item_flag(tray, &item->checked, 1);
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_item_uncheck(sni_tray *tray, uint32_t id) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    menu_item *item = find_item(tray, (int32_t)id);
+    if (item && item->radio_group && item->radio_group < tray->group_capacity) {
+        if (!item->checked) {
+            tray->stats.suppressed_updates++;
+        } else {
+            item->checked = 0;
+            if (tray->group_selected[item->radio_group] == item->id)
+                tray->group_selected[item->radio_group] = 0;
+            mark_item_props(tray, item->id);
+        }
+    } else if (item) {
+        update_item_flag(tray, &item->checked, 0);
+    }
+    pthread_mutex_unlock(&tray->lock);
+}
+
+/* Grow the group table to hold `group`. Caller holds tray->lock. */
+static int ensure_group(sni_tray *tray, uint32_t group) {
+    if (group < tray->group_capacity) return 1;
+    uint32_t cap = tray->group_capacity ? tray->group_capacity : 8;
+    while (cap <= group) cap *= 2;
+    int32_t *sel = realloc(tray->group_selected, (size_t)cap * sizeof(int32_t));
+    if (!sel) return 0;
+    memset(sel + tray->group_capacity, 0, (size_t)(cap - tray->group_capacity) * sizeof(int32_t));
+    tray->group_selected = sel;
+    tray->group_capacity = cap;
+    return 1;
+}
+
+void sni_tray_item_set_radio_group(sni_tray *tray, uint32_t id, uint32_t group) {
+    if (!tray || group == 0) return;
+    pthread_mutex_lock(&tray->lock);
+    menu_item *item = find_item(tray, (int32_t)id);
+    if (item && !item->is_separator && ensure_group(tray, group)) {
+        item->checkable = 1;
+        item->radio_group = group;
+        /* The last checked member added wins; earlier ones are cleared */
+        if (item->checked) {
+            menu_item *prev = find_item(tray, tray->group_selected[group]);
+            if (prev && prev != item) prev->checked = 0;
+            tray->group_selected[group] = item->id;
+        }
+        mark_dirty(tray, DIRTY_LAYOUT);
+    }
+    pthread_mutex_unlock(&tray->lock);
+}
+
+/* Check a radio member and clear the previous one: two toggle-state
+ * updates, no relayout. Caller holds tray->lock. */
+static void select_in_group(sni_tray *tray, menu_item *item) {
+    uint32_t group = item->radio_group;
+    menu_item *prev = find_item(tray, tray->group_selected[group]);
+    if (prev == item && item->checked) {
+        tray->stats.suppressed_updates++;
+        return;
+    }
+    if (prev && prev != item) {
+        prev->checked = 0;
+        mark_item_props(tray, prev->id);
+    }
+    item->checked = 1;
+    tray->group_selected[group] = item->id;
+    mark_item_props(tray, item->id);
+}
+
+void sni_tray_group_select(sni_tray *tray, uint32_t group, uint32_t id) {
+    if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (item) { item->checked = 0; emit_layout_updated(tray); }
+    if (item && item->radio_group == group && group < tray->group_capacity)
+        select_in_group(tray, item);
+    pthread_mutex_unlock(&tray->lock);
 }
 
 void sni_tray_item_set_icon(sni_tray *tray, uint32_t id,
                              const uint8_t *icon_data, size_t icon_len) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
+    if (!icon_data) icon_len = 0;
+    uint64_t hash = icon_len > 0 ? hash_bytes(icon_data, icon_len) : 0;
     menu_item *item = find_item(tray, (int32_t)id);
-    if (!item) return;
-    free(item->icon_data);
-    item->icon_data = NULL;
-    item->icon_len = 0;
-    if (icon_data && icon_len > 0) {
-        item->icon_data = malloc(icon_len);
-        if (item->icon_data) {
-            memcpy(item->icon_data, icon_data, icon_len);
-            item->icon_len = icon_len;
+    if (item && !item->icon_template && item->icon_len == icon_len && item->icon_hash == hash) {
+        tray->stats.suppressed_updates++;
+    } else if (item) {
+        free(item->icon_data);
+        item->icon_data = NULL;
+        item->icon_len = 0;
+        item->icon_hash = 0;
+        item->icon_template = 0;
+        if (icon_len > 0) {
+            item->icon_data = malloc(icon_len);
+            if (item->icon_data) {
+                memcpy(item->icon_data, icon_data, icon_len);
+                item->icon_len = icon_len;
+                item->icon_hash = hash;
+            }
         }
+        mark_dirty(tray, DIRTY_LAYOUT);
     }
-    emit_layout_updated(tray);
+    pthread_mutex_unlock(&tray->lock);
+}
+
+void sni_tray_item_set_icon_template(sni_tray *tray, uint32_t id,
+                                      const uint8_t *icon_data, size_t icon_len) {
+    if (!tray) return;
+    if (!icon_data) icon_len = 0;
+    /* icon_hash tracks the source image here, icon_len the mask PNG */
+    uint64_t hash = icon_len > 0 ? hash_bytes(icon_data, icon_len) : 0;
+    pthread_mutex_lock(&tray->lock);
+    menu_item *item = find_item(tray, (int32_t)id);
+    int unchanged = item && item->icon_template && item->icon_hash == hash;
+    if (unchanged) tray->stats.suppressed_updates++;
+    pthread_mutex_unlock(&tray->lock);
+    if (!item || unchanged) return;
+
+    /* Decode and encode outside the lock; only the swap is serialized */
+    size_t png_len = 0, plte_off = 0;
+    uint8_t *png = icon_len > 0 ? encode_mask_png(icon_data, icon_len, &png_len, &plte_off) : NULL;
+
+    pthread_mutex_lock(&tray->lock);
+    item = find_item(tray, (int32_t)id);  /* may have been removed meanwhile */
+    if (item) {
+        free(item->icon_data);
+        item->icon_data = NULL;
+        item->icon_len = 0;
+        item->icon_hash = 0;
+        item->icon_template = 0;
+        if (png) {
+            tint_mask_png(png, plte_off, template_tint(tray));
+            item->icon_data = png;
+            item->icon_len = png_len;
+            item->icon_hash = hash;
+            item->icon_template = 1;
+            item->icon_plte_off = plte_off;
+            png = NULL;
+        }
+        mark_dirty(tray, DIRTY_LAYOUT);
+    }
+    pthread_mutex_unlock(&tray->lock);
+    free(png);
 }
 
 void sni_tray_item_set_shortcut(sni_tray *tray, uint32_t id,
                                  const char *key,
                                  int ctrl, int shift, int alt, int super_mod) {
     if (!tray) return;
+    pthread_mutex_lock(&tray->lock);
     menu_item *item = find_item(tray, (int32_t)id);
-    if (!item) return;
-    free(item->shortcut_key);
-    item->shortcut_key = key ? strdup(key) : NULL;
-    item->shortcut_ctrl = ctrl;
-    item->shortcut_shift = shift;
-    item->shortcut_alt = alt;
-    item->shortcut_super = super_mod;
-    emit_layout_updated(tray);
+    if (item && str_equal(item->shortcut_key, key) &&
+        item->shortcut_ctrl == ctrl && item->shortcut_shift == shift &&
+        item->shortcut_alt == alt && item->shortcut_super == super_mod) {
+        tray->stats.suppressed_updates++;
+    } else if (item) {
+        free(item->shortcut_key);
+        item->shortcut_key = key ? strdup(key) : NULL;
+        item->shortcut_ctrl = ctrl;
+        item->shortcut_shift = shift;
+        item->shortcut_alt = alt;
+        item->shortcut_super = super_mod;
+        mark_dirty(tray, DIRTY_LAYOUT);
+    }
+    pthread_mutex_unlock(&tray->lock);
 }
@@ -17,20 +17,60 @@ extern "C" {
 /* Opaque tray handle */
 typedef struct sni_tray sni_tray;
 
+/* Health counters, read with sni_tray_get_stats(). */
+typedef struct {
+    uint32_t registrations;    /* watcher accepted RegisterStatusNotifierItem */
+    uint32_t reconnects;       /* session bus re-established after a loss */
+    uint32_t recoveries;       /* item visible again after a bus loss or watcher restart */
+    int64_t  last_recovery_ms; /* loss -> registered again, latest recovery; -1 if none */
+    int64_t  startup_latency_ms; /* sni_tray_create() -> first registration; -1 until then */
+    uint64_t suppressed_updates; /* setter calls dropped because nothing changed */
+} sni_tray_stats;
+
+/* org.freedesktop.appearance color-scheme, as reported by the settings portal */
+#define SNI_COLOR_SCHEME_DEFAULT 0 /* no preference, or no portal */
+#define SNI_COLOR_SCHEME_DARK    1
+#define SNI_COLOR_SCHEME_LIGHT   2
+
+/* SNI Status property */
+#define SNI_STATUS_PASSIVE         0 /* hidden, or moved to the overflow area */
+#define SNI_STATUS_ACTIVE          1
+#define SNI_STATUS_NEEDS_ATTENTION 2 /* hosts show the attention icon, if any */
+
+/* Notification events passed to sni_notification_cb. An action carries its
+ * index and reason SNI_NOTIFY_ACTION; a close carries action -1 and one of the
+ * spec's reasons (1 expired, 2 dismissed, 3 closed by call, 4 undefined). */
+#define SNI_NOTIFY_ACTION         (-1)
+#define SNI_NOTIFY_DEFAULT_ACTION (-2) /* the bubble itself was clicked */
+#define SNI_NOTIFY_FAILED          0   /* never shown: no daemon, or Notify failed */
+
+/* Scroll orientation passed to sni_scroll_cb */
+#define SNI_SCROLL_VERTICAL   0
+#define SNI_SCROLL_HORIZONTAL 1
+
 /* Callback types */
 typedef void (*sni_click_cb)(int32_t x, int32_t y, void *userdata);
 typedef void (*sni_menu_item_cb)(uint32_t id, void *userdata);
 typedef void (*sni_menu_opened_cb)(void *userdata);
+typedef void (*sni_color_scheme_cb)(int32_t scheme, void *userdata);
+typedef void (*sni_scroll_cb)(int32_t delta, int orientation, void *userdata);
+typedef void (*sni_host_cb)(int present, void *userdata);
+typedef void (*sni_notification_cb)(uint32_t token, int32_t action, int32_t reason,
+                                    void *userdata);
 
 /* ── Lifecycle ─────────────────────────────────────────────────────── */
 
 /* Create a new tray instance. Returns NULL on failure.
- * icon_data/icon_len: PNG/JPG bytes for the tray icon.
+ * icon_data/icon_len: PNG/JPG bytes for the tray icon. They are copied and
+ * decoded on a worker thread, so this returns without waiting for it.
  * tooltip: tooltip text (UTF-8). */
 sni_tray *sni_tray_create(const uint8_t *icon_data, size_t icon_len,
                            const char *tooltip);
 
 /* Start the D-Bus event loop in the current thread (blocks).
+ * Registration with the StatusNotifierWatcher is asynchronous and repeated
+ * whenever the watcher restarts; a lost bus connection is re-established
+ * with backoff and the full tray state replayed.
  * Call sni_tray_quit() from another thread to unblock. */
 int sni_tray_run(sni_tray *tray);
 
@@ -43,10 +83,49 @@ void sni_tray_destroy(sni_tray *tray);
 
 /* ── Tray properties ───────────────────────────────────────────────── */
 
+/* All property and item setters compare against the current state (icons by
+ * content hash) and do nothing, not even a signal, when the value is the same. */
+
 void sni_tray_set_icon(sni_tray *tray, const uint8_t *icon_data, size_t icon_len);
+
+/* Tray icon as ready-made pixmaps: count square RGBA (straight alpha) images of
+ * sizes[i] pixels, back to back in rgba, smallest first. Nothing is decoded or
+ * resampled, so a caller that renders at the largest size gets sharp icons at
+ * every size. A buffer whose length does not match the sizes is ignored. */
+void sni_tray_set_icon_pixmaps(sni_tray *tray, const uint8_t *rgba, size_t len,
+                               const int *sizes, int count);
+
 void sni_tray_set_title(sni_tray *tray, const char *title);
 void sni_tray_set_tooltip(sni_tray *tray, const char *tooltip);
 
+/* Hide (Passive), show (Active) or alert (NeedsAttention) without tearing the
+ * item down: a change is one NewStatus signal. Default Active. */
+void sni_tray_set_status(sni_tray *tray, int status);
+
+/* Icon shown while the status is NeedsAttention (PNG/JPG bytes, NULL to
+ * clear). It is decoded here, ahead of time, not when the alert fires. */
+void sni_tray_set_attention_icon(sni_tray *tray, const uint8_t *icon_data, size_t icon_len);
+
+/* Setters never emit D-Bus signals themselves: they mark the property dirty
+ * and the event loop emits at most once per interval, dropping intermediate
+ * states. Default 16 ms; 0 flushes on the next loop iteration. */
+void sni_tray_set_flush_interval(sni_tray *tray, uint32_t interval_ms);
+
+/* Group several setters into one update: nothing is flushed between
+ * begin and end, so hosts see the icon, tooltip and menu change together.
+ * Calls nest; every begin needs its end. */
+void sni_tray_begin_update(sni_tray *tray);
+void sni_tray_end_update(sni_tray *tray);
+
+/* Template mode: the tray icon only contributes its alpha and is painted
+ * white on a dark panel, black on a light one. Applies to the current icon
+ * and every later one. */
+void sni_tray_set_icon_template(sni_tray *tray, int enabled);
+
+/* Panel appearance (1 = dark, the default). Re-tints the tray icon and all
+ * template menu icons in place; no image is decoded again. */
+void sni_tray_set_dark_mode(sni_tray *tray, int dark);
+
 /* ── Click callbacks ───────────────────────────────────────────────── */
 
 void sni_tray_set_click_callback(sni_tray *tray, sni_click_cb cb, void *userdata);
@@ -54,9 +133,67 @@ void sni_tray_set_rclick_callback(sni_tray *tray, sni_click_cb cb, void *userdat
 void sni_tray_set_menu_callback(sni_tray *tray, sni_menu_item_cb cb, void *userdata);
 void sni_tray_set_menu_opened_callback(sni_tray *tray, sni_menu_opened_cb cb, void *userdata);
 
+/* Second Activate within the double-click interval (500 ms). It replaces the
+ * second single click rather than following it. */
+void sni_tray_set_dclick_callback(sni_tray *tray, sni_click_cb cb, void *userdata);
+
+/* SecondaryActivate, which hosts send for a middle click. */
+void sni_tray_set_middle_click_callback(sni_tray *tray, sni_click_cb cb, void *userdata);
+
+/* When enabled, a single click is held until the double-click interval has
+ * passed, so a double click never reports a single click first. Off by default. */
+void sni_tray_set_defer_single_click(sni_tray *tray, int enabled);
+
+/* Wheel/touchpad scrolling on the icon. Deltas are summed per orientation and
+ * delivered at most once per flush interval, one call per orientation. */
+void sni_tray_set_scroll_callback(sni_tray *tray, sni_scroll_cb cb, void *userdata);
+
+/* ── Notifications ─────────────────────────────────────────────────── */
+
+/* Post a desktop notification through org.freedesktop.Notifications on the
+ * tray's own connection. Returns immediately with a token (> 0) that
+ * identifies the notification in the callback. The call is sent by the event
+ * loop without waiting for the reply. With `with_icon`, the decoded tray icon
+ * is attached as pixels.
+ *
+ * Bursts are rate limited (see sni_tray_set_notify_rate). While a
+ * notification waits, a new one with the same summary replaces it, and its
+ * token never reports. At most 8 actions; labels only, the keys are indices. */
+uint32_t sni_tray_notify(sni_tray *tray, const char *summary, const char *body,
+                         const char *const *actions, int action_count,
+                         int with_icon, int32_t timeout_ms);
+
+/* Token bucket: `burst` notifications at once, then one per `interval_ms`.
+ * Default 4 and 250 ms. */
+void sni_tray_set_notify_rate(sni_tray *tray, int burst, int interval_ms);
+
+/* ActionInvoked and NotificationClosed for our notifications, from the loop. */
+void sni_tray_set_notification_callback(sni_tray *tray, sni_notification_cb cb, void *userdata);
+
+/* ── Host presence ─────────────────────────────────────────────────── */
+
+/* Called from the event loop when a StatusNotifierHost appears (1) or the last
+ * one goes away (0). Without a host no signal is emitted: updates collapse into
+ * pending state that is sent once when a host registers. */
+void sni_tray_set_host_callback(sni_tray *tray, sni_host_cb cb, void *userdata);
+
+/* 1 if a host is registered, 0 if not, -1 while unknown (no watcher answer
+ * yet, or a watcher without IsStatusNotifierHostRegistered). Thread-safe. */
+int sni_tray_get_host_present(sni_tray *tray);
+
+/* Called from the event loop when the portal's color-scheme actually changes,
+ * including the first successful read after (re)connecting. */
+void sni_tray_set_color_scheme_callback(sni_tray *tray, sni_color_scheme_cb cb, void *userdata);
+
+/* Last color scheme seen on the portal (SNI_COLOR_SCHEME_*). Thread-safe. */
+int32_t sni_tray_get_color_scheme(sni_tray *tray);
+
 /* Get last click coordinates (from Activate/ContextMenu). */
 void sni_tray_get_last_click_xy(sni_tray *tray, int32_t *x, int32_t *y);
 
+/* Snapshot of the health counters. Thread-safe. */
+void sni_tray_get_stats(sni_tray *tray, sni_tray_stats *out);
+
 /* ── Menu management ───────────────────────────────────────────────── */
 
 /* Clear all menu items. */
@@ -85,6 +222,19 @@ uint32_t sni_tray_add_sub_menu_item_checkbox(sni_tray *tray, uint32_t parent_id,
 /* Add a separator under parent_id. */
 void sni_tray_add_sub_separator(sni_tray *tray, uint32_t parent_id);
 
+/* In-place edits for menus that are diffed rather than rebuilt. Ids stay
+ * valid across them (new ones are never reused before a reset), so a host
+ * with the menu open keeps addressing the same items.
+ * Insert places the new item right before before_id under parent_id (0 for
+ * root), or last when before_id is 0; it returns the new id, or 0. */
+uint32_t sni_tray_insert_menu_item(sni_tray *tray, uint32_t parent_id, uint32_t before_id,
+                                   const char *title, int checkable, int checked,
+                                   int separator);
+/* Re-parent and/or reorder an item; its subtree follows. Returns 1 on success. */
+int sni_tray_move_menu_item(sni_tray *tray, uint32_t id, uint32_t parent_id, uint32_t before_id);
+/* Remove an item with its whole subtree. Returns 1 on success. */
+int sni_tray_remove_menu_item(sni_tray *tray, uint32_t id);
+
 /* ── Per-item operations ───────────────────────────────────────────── */
 
 int  sni_tray_item_set_title(sni_tray *tray, uint32_t id, const char *title);
@@ -94,9 +244,23 @@ void sni_tray_item_show(sni_tray *tray, uint32_t id);
 void sni_tray_item_hide(sni_tray *tray, uint32_t id);
 void sni_tray_item_check(sni_tray *tray, uint32_t id);
 void sni_tray_item_uncheck(sni_tray *tray, uint32_t id);
+/* Make a checkable item a member of radio group `group` (> 0). A checked
+ * member becomes the group's selection. */
+void sni_tray_item_set_radio_group(sni_tray *tray, uint32_t id, uint32_t group);
+
+/* Select `id` in its radio group: unchecks the previous selection without
+ * scanning the group, and sends one ItemsPropertiesUpdated for the two
+ * changed items instead of a LayoutUpdated. */
+void sni_tray_group_select(sni_tray *tray, uint32_t group, uint32_t id);
+
 void sni_tray_item_set_icon(sni_tray *tray, uint32_t id,
                              const uint8_t *icon_data, size_t icon_len);
 
+/* Like sni_tray_item_set_icon(), but only the image's alpha is kept and the
+ * icon follows sni_tray_set_dark_mode(). */
+void sni_tray_item_set_icon_template(sni_tray *tray, uint32_t id,
+                                      const uint8_t *icon_data, size_t icon_len);
+
 /* Set a display-only keyboard shortcut hint on a menu item.
  * key: DBusMenu key name (e.g. "s", "F1", "Delete").
  * Modifier flags: 1 = active, 0 = inactive. */